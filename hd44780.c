@@ -43,17 +43,43 @@ static inline void    LCD_OutputUpperNibble( uint8_t ch );
 static inline void    LCD_OutputLowerNibble( uint8_t ch );
 #endif
 static inline void    LCD_Output      ( uint8_t ch );
+static inline void    LCD_InitWrite   ( uint8_t ch );
 static inline uint8_t LCD_IsBusy      ( void );
+static uint8_t LCD_PutCode            ( uint8_t ch );
+#ifdef LCD_VIEWPORT_SUPPORT
+static uint8_t LCD_VP_PutCode         ( LCD_Viewport * vp, uint8_t ch );
+#endif
 
 /** Different platforms require different delay solutions, so
   * so below is a macro to substitute your own,
   */
 #ifdef _HW_INTERFACE_GD32_H
 #define Delay_ms( ms_delay ) delay_millis( ms_delay )
+#define LCD_Time_us()        Read_Micros()
 #endif
 
 #ifdef _HW_INTERFACE_STM32_H
 #define Delay_ms( ms_delay ) HAL_Delay( ms_delay )
+#define LCD_Time_us()        Read_Micros()
+#ifdef LCD_WAVE_TIM
+#define LCD_WAVE_PLAY( port, words, count, done ) Wave_Play( port, words, count, done )
+#endif
+#endif
+
+/** Byte compare and swap for the lock-free paths.  The GCC builtin needs
+  * LDREXB/STREXB, so Cortex-M0 targets should substitute a version that
+  * briefly masks interrupts.
+  */
+#ifndef LCD_ATOMIC_CAS
+#define LCD_ATOMIC_CAS( ptr, expected, desired ) \
+  __sync_bool_compare_and_swap( ( ptr ), ( expected ), ( desired ) )
+#endif
+
+/** Full memory barrier, ordering ring buffer stores against their index
+  * updates.
+  */
+#ifndef LCD_MEMORY_BARRIER
+#define LCD_MEMORY_BARRIER()        __sync_synchronize()
 #endif
 
 /* HD44780 bootstrap values for 4-bit initialization sequence. */
@@ -80,809 +106,5833 @@ static          uint8_t   dd_addr;
 static const    uint8_t   hd_map[]        = HD_ADDR_MAP;
 
 
-/** VFD has four different intensities VFD25 VFD50 VFD75 and VFD100
+/** Adaptive busy waiting.
   *
-  * Brightness will vary from 25% to 100%
+  * hd_busy_exec is the typical execution time of the last transfer,
+  * which ended at hd_busy_start.  It is 0 once a busy wait has seen the
+  * controller idle, and LCD_BUSY_UNKNOWN after writes the driver does
+  * not time, which are always polled.
   */
-#ifdef HD_ISVFD
-char vfd_intensity = VFD100;
-#endif
+#ifdef LCD_BUSY_ADAPTIVE_SUPPORT
 
- 
-// HACK: Time wasting routine.  It was being optimised away until it's parameters were declared
-// volatile.  This comes from use in CCS C which has this as a built-in, but they mean machine
-// cycles.
-//
-void delay_cycles( volatile uint8_t cycles_to_waste )
-{
-  while( cycles_to_waste-- );
-}
+#define LCD_BUSY_UNKNOWN            0xFFFFu
 
+static          uint32_t  hd_busy_start   = 0;
+static          uint16_t  hd_busy_exec    = LCD_BUSY_UNKNOWN;
 
-/** Set the RS pin state
-  *
-  * @param state: 1 = Data Register, 0 = Instruction Register
-  * @retval none
-  */
-static inline void LCD_SetRS(uint8_t state)
-{
-  Output_Pin( LCD_RS, LCD_RS_BANK, state );
-  delay_cycles( E_CYCLES );
-}
+#define LCD_BUSY_MARK( exec_us )    ( hd_busy_start = LCD_Time_us(), hd_busy_exec = ( exec_us ) )
+#define LCD_BUSY_SETTLE()           do { if( hd_busy_exec && hd_busy_exec != LCD_BUSY_UNKNOWN ) LCD_BusyWait(); } while( 0 )
+#else
+#define LCD_BUSY_MARK( exec_us )
+#define LCD_BUSY_SETTLE()
+#endif
 
 
-/** Set the Read/Write pin state
+/** Driver statistics
   *
-  * @param state: 1 = Read, 0 = Write
-  * @retval none
+  * Each counter hides behind its own macro so that removing it from the
+  * configuration removes the code from the bus paths as well.
   */
-static inline void LCD_SetRNW(uint8_t state)
-{
-  Output_Pin( LCD_RNW, LCD_RNW_BANK, state );
-  delay_cycles( E_CYCLES );
-}
-
+#ifdef LCD_STATS_SUPPORT
+static          LCD_Stats hd_stats;
+static          uint8_t   hd_stat_class   = LCD_STAT_CLASS_COMMAND;
+static          uint8_t   hd_stat_bus_in  = 0;
+#define LCD_STAT_CLASS( op_class )  ( hd_stat_class = ( op_class ) )
+#else
+#define LCD_STAT_CLASS( op_class )
+#endif
 
-/** Set the Enable pin state
-  *
-  * @param state: 1 = Enable, 0 = Disable
-  * @retval none
-  */
-static inline void LCD_SetE( uint8_t state )
-{
-  Output_Pin( LCD_E, LCD_E_BANK, state );
-  delay_cycles( E_CYCLES );
-}
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_COMMANDS )
+#define LCD_STAT_COMMAND()          ( hd_stats.commands++ )
+#else
+#define LCD_STAT_COMMAND()
+#endif
 
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_DATA )
+#define LCD_STAT_DATA()             ( hd_stats.data_bytes++ )
+#else
+#define LCD_STAT_DATA()
+#endif
 
-/* Set the LCD bus to input mode 
- *
- * @param none
- * @retval none
- */
-static inline void LCD_SetBusInput( void )
-{
-  Set_Input_Pin( LCD_D7, LCD_D7_BANK );
-  Set_Input_Pin( LCD_D6, LCD_D6_BANK );
-  Set_Input_Pin( LCD_D5, LCD_D5_BANK );
-  Set_Input_Pin( LCD_D4, LCD_D4_BANK );
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_STROBES )
+#define LCD_STAT_STROBE()           ( hd_stats.strobes++ )
+#else
+#define LCD_STAT_STROBE()
+#endif
 
-#ifdef LCD_BUS8BIT
-  Set_Input_Pin( LCD_D3, LCD_D3_BANK );
-  Set_Input_Pin( LCD_D2, LCD_D2_BANK );
-  Set_Input_Pin( LCD_D1, LCD_D1_BANK );
-  Set_Input_Pin( LCD_D0, LCD_D0_BANK );
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_POLLS )
+#define LCD_STAT_POLL()             ( hd_stats.busy_polls++ )
+#else
+#define LCD_STAT_POLL()
 #endif
-}
 
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_RECONFIG )
+#define LCD_STAT_BUS_INPUT()        { hd_stats.pin_reconfigs++; hd_stat_bus_in = 1; }
+#define LCD_STAT_BUS_OUTPUT()       { if( hd_stat_bus_in ) { hd_stats.pin_reconfigs++; hd_stat_bus_in = 0; } }
+#else
+#define LCD_STAT_BUS_INPUT()
+#define LCD_STAT_BUS_OUTPUT()
+#endif
 
-/** Read the LCD bus input  
-  *
-  * @param none
-  * @retval byte read from the LCD bus
-  */
-static inline uint8_t LCD_Input( void )
-{
-  uint8_t ch;
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_SKIPPED )
+#define LCD_STAT_SKIPPED( count )   ( hd_stats.bytes_skipped += ( count ) )
+#else
+#define LCD_STAT_SKIPPED( count )
+#endif
 
-  LCD_SetBusInput();
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_TIMEOUTS )
+#define LCD_STAT_TIMEOUT()          ( hd_stats.timeouts++ )
+#else
+#define LCD_STAT_TIMEOUT()
+#endif
 
-  ch  = Read_Pin( LCD_D7, LCD_D7_BANK ); ch <<= 1;
-  ch |= Read_Pin( LCD_D6, LCD_D6_BANK ); ch <<= 1;
-  ch |= Read_Pin( LCD_D5, LCD_D5_BANK ); ch <<= 1;
-  ch |= Read_Pin( LCD_D4, LCD_D4_BANK );
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_BLOCKED_TIME )
+#define LCD_STAT_WAIT_START()       uint32_t stat_wait_start = LCD_Time_us()
+#define LCD_STAT_WAIT_END()         LCD_StatBlocked( LCD_Time_us() - stat_wait_start )
+#else
+#define LCD_STAT_WAIT_START()
+#define LCD_STAT_WAIT_END()
+#endif
 
-#ifdef LCD_BUS8BIT
-  ch <<= 1;
-  ch |= Read_Pin( LCD_D3, LCD_D3_BANK ); ch <<= 1;
-  ch |= Read_Pin( LCD_D2, LCD_D2_BANK ); ch <<= 1;
-  ch |= Read_Pin( LCD_D1, LCD_D1_BANK ); ch <<= 1;
-  ch |= Read_Pin( LCD_D0, LCD_D0_BANK );
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_BUSY_HIST )
+#define LCD_STAT_BUSY_ITERATIONS( count ) LCD_StatBusyIterations( count )
+#else
+#define LCD_STAT_BUSY_ITERATIONS( count )
 #endif
 
-  return ch;
-}
 
+/** Bus transaction trace
+  *
+  * A ring of fixed size entries, oldest overwritten first.  Consecutive
+  * busy flag reads are folded into one entry with a poll count.
+  */
+#ifdef LCD_TRACE_SUPPORT
 
-/* Output to LCD bus
- * @param ch: byte to output to the LCD bus
- *
- * @retval none
- */
-static inline void LCD_Output( uint8_t ch )
-{
-  LCD_OutputUpperNibble( ch );
-#ifdef LCD_BUS8BIT
-  LCD_OutputLowerNibble( ch );
+#if ( LCD_TRACE_DEPTH & ( LCD_TRACE_DEPTH - 1 ) ) != 0
+  #error LCD_TRACE_DEPTH must be a power of two.
 #endif
-}
 
+static          LCD_TraceEntry hd_trace[ LCD_TRACE_DEPTH ];
+static          uint16_t  hd_trace_head   = 0;
+static          uint16_t  hd_trace_count  = 0;
+static          uint8_t   hd_trace_on     = 1;
 
-/* Output only the upper nibble (D7..D4) to the LCD bus.
- * Useful during 4-bit startup when the controller has not yet latched 4-bit mode.
- */
-static inline void LCD_OutputUpperNibble( uint8_t ch )
-{
-  Output_Pin( LCD_D7, LCD_D7_BANK, ch & 0x80 );
-  Output_Pin( LCD_D6, LCD_D6_BANK, ch & 0x40 );
-  Output_Pin( LCD_D5, LCD_D5_BANK, ch & 0x20 );
-  Output_Pin( LCD_D4, LCD_D4_BANK, ch & 0x10 );
-}
+#ifdef LCD_BUS4BIT
+#define LCD_TRACE_PHASE             LCD_TRACE_NIBBLE_PAIR
+#else
+#define LCD_TRACE_PHASE             0u
+#endif
 
+#define LCD_TRACE( trace_flags, trace_value ) LCD_TraceRecord( ( trace_flags ) | LCD_TRACE_PHASE, ( trace_value ) )
+#define LCD_TRACE_INIT( trace_value )         LCD_TraceRecord( LCD_INIT_TRACE_PHASE, ( trace_value ) )
+#define LCD_TRACE_POLL( trace_busy )          LCD_TracePoll( ( trace_busy ) )
+#else
+#define LCD_TRACE( trace_flags, trace_value )
+#define LCD_TRACE_INIT( trace_value )
+#define LCD_TRACE_POLL( trace_busy )
+#endif
 
-#ifdef LCD_BUS8BIT
-/* Output only the lower nibble (D3..D0) to the LCD bus. */
-static inline void LCD_OutputLowerNibble( uint8_t ch )
-{
-  Output_Pin( LCD_D3, LCD_D3_BANK, ch & 0x08 );
-  Output_Pin( LCD_D2, LCD_D2_BANK, ch & 0x04 );
-  Output_Pin( LCD_D1, LCD_D1_BANK, ch & 0x02 );
-  Output_Pin( LCD_D0, LCD_D0_BANK, ch & 0x01 );
-}
+#ifdef LCD_BUS4BIT
+#define LCD_INIT_TRACE_PHASE        LCD_TRACE_NIBBLE_ONLY
+#else
+#define LCD_INIT_TRACE_PHASE        0u
 #endif
 
 
-/** Read the busy flag from the LCD
+/** Frame buffer and controller tracking
   *
-  * @param none
-  * @retval uint8_t: busy flag state
+  * Both buffers are indexed by DDRAM cell in address counter order, so
+  * cell + 1 is always where the controller writes next in INC mode.
   */
-static inline uint8_t LCD_IsBusy( void )
-{
-  uint8_t busybit;
+#define LCD_DDRAM_CELLS             80u
+#define LCD_DDRAM_LINE              40u
+
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+
+#define LCD_CELL_UNKNOWN            0xFFu
+
+#define LCD_PLAN_COST_COMMAND       ( LCD_COST_XFER_US + LCD_COST_EXEC_US )
+#define LCD_PLAN_COST_DATA          ( LCD_COST_XFER_US + LCD_COST_DATA_US )
+#define LCD_PLAN_COST_CLEAR         ( LCD_COST_XFER_US + LCD_COST_CLEAR_US )
+
+static          uint8_t   hd_fb_glass[ LCD_DDRAM_CELLS ];
+static          uint8_t   hd_fb_stale[ ( LCD_DDRAM_CELLS + 7u ) / 8u ];
+static          uint8_t   hd_fb_frame[ LCD_DDRAM_CELLS ];
+static          uint8_t   hd_fb_ac        = LCD_CELL_UNKNOWN;
+static          uint8_t   hd_fb_entry     = ENT_MODE | INC;
+static          uint8_t   hd_fb_flushing  = 0;
+
+/* Every byte value is a character, so glass cells whose contents are
+   not known are marked in a separate bitmap. */
+#define LCD_GLASS_STALE( cell )     ( hd_fb_stale[ ( cell ) >> 3 ] & ( 1u << ( ( cell ) & 7u ) ) )
+#define LCD_GLASS_KNOWN( cell )     ( hd_fb_stale[ ( cell ) >> 3 ] &= ( uint8_t )~( 1u << ( ( cell ) & 7u ) ) )
+#define LCD_GLASS_IS( cell, ch )    ( !LCD_GLASS_STALE( cell ) && hd_fb_glass[ cell ] == ( ch ) )
+static          uint8_t   hd_fb_resume    = 0;
+
+static uint8_t LCD_CellIndex( uint8_t addr );
+static void LCD_TrackCommand( uint8_t cmd );
+static void LCD_TrackData( uint8_t dat );
+#ifdef LCD_READ_DD_SUPPORT
+static void LCD_TrackRead( void );
+#endif
 
-  /* Prep LCD for busy flag read */
-  LCD_SetBusInput();
-  LCD_SetRS( INSTR_REG );
-  LCD_SetRNW( READ );
-  LCD_SetE( ENABLE );
-  delay_cycles( E_CYCLES );
+#define LCD_TRACK_COMMAND( cmd )    LCD_TrackCommand( cmd )
+#define LCD_TRACK_DATA( dat )       LCD_TrackData( dat )
+#define LCD_TRACK_READ()            LCD_TrackRead()
+#else
+#define LCD_TRACK_COMMAND( cmd )
+#define LCD_TRACK_DATA( dat )
+#define LCD_TRACK_READ()
+#endif
 
-  /* Read busy flag */
-  busybit = Read_Pin( LCD_D7, LCD_D7_BANK );
 
-  /* Turn off the Enable pin */
-  LCD_SetE( DISABLE );
-  delay_cycles( E_CYCLES );
+/** Presentation mode
+  *
+  * While presenting, the character API draws into the frame buffer and
+  * only LCD_Present() touches the bus.
+  */
+#ifdef LCD_PRESENT_SUPPORT
 
-  /* Do it again for 4-bit mode, ignoring the result */
-#ifndef LCD_BUS8BIT
-  LCD_SetE( ENABLE );
-  delay_cycles( E_CYCLES );
-  
-  LCD_SetE( DISABLE );
-  delay_cycles( E_CYCLES );
+#ifndef LCD_FRAMEBUFFER_SUPPORT
+  #error LCD_PRESENT_SUPPORT needs LCD_FRAMEBUFFER_SUPPORT.
 #endif
-  
-  return busybit;
-}
 
+static          uint8_t   hd_presenting   = 0;
+static          uint32_t  hd_present_last = 0;
+static          uint32_t  hd_present_us   = LCD_PRESENT_INTERVAL_MS * 1000UL;
+#endif
 
-#ifdef LCD_READ_DD_SUPPORT
 
-/** Read Display Data RAM at the specified address
+/** Triple buffered screen updates
   *
-  * @param dd_read_addr: address to read from
-  * @retval uint8_t: data read from DDRAM
+  * Writers draw into hd_db_draw, which never changes role.  LCD_Swap()
+  * copies it into the back buffer and publishes that as the ready
+  * buffer, and the consumer takes the ready buffer as its front.  The
+  * three buffer roles live in one byte changed only by compare and
+  * swap, so neither side ever waits for the other.  hd_db_swapping is
+  * 1 while a swap copies and 2 if another swap arrived meanwhile.
   */
-uint8_t LCD_Read_DDRAM( uint8_t dd_read_addr, uint8_t * dd_data )
-{
-  if( dd_data == NULL ) return LCD_RESULT_ERROR;
+#ifdef LCD_DOUBLE_BUFFER_SUPPORT
 
-  if( hd_status & LCD_STATUS_TIMEOUT )
-  {
-    *dd_data = LCD_READ_FALLBACK_VALUE;
-    return LCD_RESULT_ERROR;
-  }
+#ifndef LCD_FRAMEBUFFER_SUPPORT
+  #error LCD_DOUBLE_BUFFER_SUPPORT needs LCD_FRAMEBUFFER_SUPPORT.
+#endif
 
-  /* Set DDRAM address to read from */
-  LCD_Command( SET_DDRAM_ADD | dd_read_addr );
-  if( !LCD_BusyWait() )
-  {
-    *dd_data = LCD_READ_FALLBACK_VALUE;
-    return LCD_RESULT_ERROR;
-  }
-  LCD_SetRS( DATA_REG );
-  LCD_SetRNW( READ );
+#define LCD_DB_BACK( state )        ( ( state ) & 0x03u )
+#define LCD_DB_READY( state )       ( ( ( state ) >> 2 ) & 0x03u )
+#define LCD_DB_FRONT( state )       ( ( ( state ) >> 4 ) & 0x03u )
+#define LCD_DB_FRESH                0x40u
+#define LCD_DB_STATE( back, ready, front ) \
+                                    ( ( uint8_t )( ( back ) | ( ( ready ) << 2 ) | ( ( front ) << 4 ) ) )
+
+static          uint8_t   hd_db_draw[ LCD_DDRAM_CELLS ];
+static          uint8_t   hd_db_buf[ 3 ][ LCD_DDRAM_CELLS ];
+static volatile uint8_t   hd_db_state     = LCD_DB_STATE( 0, 1, 2 );
+static volatile uint8_t   hd_db_swapping  = 0;
+#endif
 
-  /* Prepare LCD for data read */
-  delay_cycles( E_CYCLES );
-  LCD_SetE( ENABLE );
-  delay_cycles( E_CYCLES );
 
-  /* Read data */
-  *dd_data = LCD_Input();
+/** Multi-producer draw queue
+  *
+  * A bounded ring where every slot carries a sequence number.  Producers
+  * claim a slot by advancing the tail with compare and swap, fill it in
+  * and then publish it by bumping its sequence.  The one consumer takes
+  * slots in order once they are published.
+  */
+#ifdef LCD_QUEUE_SUPPORT
 
-  /* Turn off Enable pin */
-  LCD_SetE( DISABLE );
-  delay_cycles( E_CYCLES );
+#ifndef LCD_FRAMEBUFFER_SUPPORT
+  #error LCD_QUEUE_SUPPORT needs LCD_FRAMEBUFFER_SUPPORT.
+#endif
 
-/* Read second nibble for 4-bit mode */
-#ifdef LCD_BUS4BIT
-  LCD_SetE( ENABLE );
-  delay_cycles( E_CYCLES );
-  *dd_data <<= 4;
-  *dd_data |= LCD_Input();
-  LCD_SetE( DISABLE );
-  delay_cycles( E_CYCLES );
-#endif  // LCD_READ_DD_SUPPORT 4-bit mode
+#if ( LCD_QUEUE_DEPTH & ( LCD_QUEUE_DEPTH - 1 ) ) != 0 || LCD_QUEUE_DEPTH > 64
+  #error LCD_QUEUE_DEPTH must be a power of two no greater than 64.
+#endif
 
-  return LCD_RESULT_OK;
-}
-#endif // LCD_READ_DD_SUPPORT
+#define LCD_OP_TEXT                 0u
+#define LCD_OP_GLYPH                1u
 
+#if LCD_QUEUE_TEXT_LEN > LCD_CGRAM_CHAR_ROWS
+  #define LCD_OP_DATA_LEN           LCD_QUEUE_TEXT_LEN
+#else
+  #define LCD_OP_DATA_LEN           LCD_CGRAM_CHAR_ROWS
+#endif
 
-#ifdef LCD_READCHAR_SUPPORT
+typedef struct
+{
+  volatile uint8_t  seq;
+  uint8_t           op;
+  uint8_t           x;
+  uint8_t           y;
+  uint8_t           len;
+  uint8_t           data[ LCD_OP_DATA_LEN ];
+} LCD_QueueSlot;
+
+static          LCD_QueueSlot hd_q_slot[ LCD_QUEUE_DEPTH ];
+static volatile uint8_t   hd_q_tail       = 0;
+static          uint8_t   hd_q_head       = 0;
+#endif
 
-/** Read character at the display coordinates specified, with
-  * (0,0) being the top left of the display.
+
+/** UTF-8 translation tables, built at compile time.
   *
-  * @param rc_x: X coordinate to read from
-  * @param rc_y: Y coordinate to read from
-  * @retval uint8_t: character read from the specified location
+  * Each row of LCD_UTF8_CHARS gives a code point with its code in the
+  * A00 (Japanese) and A02 (European) character ROMs, 0 where that ROM
+  * lacks it.  Rows must stay sorted by code point.  Only the column for
+  * LCD_CHAR_ROM is compiled in.
   */
-uint8_t LCD_Readchar( uint8_t rc_x, uint8_t rc_y, uint8_t * rc_data )
-{
-  int addr_to_sample;
-
-  if( rc_data == NULL ) return LCD_RESULT_ERROR;
+#ifdef LCD_UTF8_SUPPORT
+
+#define LCD_UTF8_CHARS( X ) \
+  X( 0x00A1, 0x00, 0xA1 )     /* inverted exclamation */ \
+  X( 0x00A2, 0xEC, 0xA2 )     /* cent */ \
+  X( 0x00A3, 0x00, 0xA3 )     /* pound */ \
+  X( 0x00A5, 0x5C, 0xA5 )     /* yen */ \
+  X( 0x00A7, 0x00, 0xA7 )     /* section */ \
+  X( 0x00A9, 0x00, 0xA9 )     /* copyright */ \
+  X( 0x00AB, 0x00, 0xAB )     /* left guillemet */ \
+  X( 0x00B0, 0xDF, 0xB0 )     /* degree */ \
+  X( 0x00B1, 0x00, 0xB1 )     /* plus-minus */ \
+  X( 0x00B2, 0x00, 0xB2 )     /* superscript two */ \
+  X( 0x00B3, 0x00, 0xB3 )     /* superscript three */ \
+  X( 0x00B5, 0xE4, 0xB5 )     /* micro */ \
+  X( 0x00B6, 0x00, 0xB6 )     /* pilcrow */ \
+  X( 0x00B7, 0xA5, 0xB7 )     /* middle dot */ \
+  X( 0x00BB, 0x00, 0xBB )     /* right guillemet */ \
+  X( 0x00BF, 0x00, 0xBF )     /* inverted question */ \
+  X( 0x00E4, 0xE1, 0xE4 )     /* a umlaut */ \
+  X( 0x00F1, 0xEE, 0xF1 )     /* n tilde */ \
+  X( 0x00F6, 0xEF, 0xF6 )     /* o umlaut */ \
+  X( 0x00F7, 0xFD, 0xF7 )     /* division */ \
+  X( 0x00FC, 0xF5, 0xFC )     /* u umlaut */ \
+  X( 0x03A3, 0xF6, 0x00 )     /* capital sigma */ \
+  X( 0x03A9, 0xF4, 0x00 )     /* capital omega */ \
+  X( 0x03B1, 0xE0, 0x00 )     /* alpha */ \
+  X( 0x03B2, 0xE2, 0x00 )     /* beta */ \
+  X( 0x03B5, 0xE3, 0x00 )     /* epsilon */ \
+  X( 0x03B8, 0xF2, 0x00 )     /* theta */ \
+  X( 0x03BC, 0xE4, 0xB5 )     /* mu */ \
+  X( 0x03C0, 0xF7, 0x00 )     /* pi */ \
+  X( 0x03C1, 0xE6, 0x00 )     /* rho */ \
+  X( 0x03C3, 0xE5, 0x00 )     /* sigma */ \
+  X( 0x2190, 0x7F, 0x00 )     /* left arrow */ \
+  X( 0x2192, 0x7E, 0x00 )     /* right arrow */ \
+  X( 0x221A, 0xE8, 0x00 )     /* square root */ \
+  X( 0x221E, 0xF3, 0x00 )     /* infinity */ \
+  X( 0x2588, 0xFF, 0x00 )     /* full block */ \
+  X( 0x4E07, 0xFB, 0x00 )     /* ten thousand */ \
+  X( 0x5343, 0xFA, 0x00 )     /* thousand */ \
+  X( 0x5186, 0xFC, 0x00 )     /* yen kanji */
+
+#if LCD_CHAR_ROM == LCD_ROM_A02
+  #define LCD_UTF8_ROM( a00, a02 )  ( a02 )
+  #define LCD_UTF8_ASCII( ch )      ( ch )
+  #define LCD_UTF8_RANGE_FIRST      0x00C0    // Latin-1 letters sit at their own codes
+  #define LCD_UTF8_RANGE_LAST       0x00FF
+  #define LCD_UTF8_RANGE_OFFSET     0x0000
+#else
+  #define LCD_UTF8_ROM( a00, a02 )  ( a00 )
+  #define LCD_UTF8_ASCII( ch )      ( ( ch ) == '\\' || ( ch ) == '~' ? 0 : ( ch ) )
+  #define LCD_UTF8_RANGE_FIRST      0xFF61    // Halfwidth katakana
+  #define LCD_UTF8_RANGE_LAST       0xFF9F
+  #define LCD_UTF8_RANGE_OFFSET     0xFEC0
+#endif
 
-  addr_to_sample = LCD_DDRAM_Addr( rc_x, rc_y );
+#define LCD_UTF8_RAW_FIRST          0xF700    // U+F7xx sends ROM code xx unchanged
 
-  return LCD_Read_DDRAM( addr_to_sample, rc_data );
-}
+#define LCD_UTF8_ROW16( base ) \
+  LCD_UTF8_ASCII( base + 0x0 ), LCD_UTF8_ASCII( base + 0x1 ), LCD_UTF8_ASCII( base + 0x2 ), LCD_UTF8_ASCII( base + 0x3 ), \
+  LCD_UTF8_ASCII( base + 0x4 ), LCD_UTF8_ASCII( base + 0x5 ), LCD_UTF8_ASCII( base + 0x6 ), LCD_UTF8_ASCII( base + 0x7 ), \
+  LCD_UTF8_ASCII( base + 0x8 ), LCD_UTF8_ASCII( base + 0x9 ), LCD_UTF8_ASCII( base + 0xA ), LCD_UTF8_ASCII( base + 0xB ), \
+  LCD_UTF8_ASCII( base + 0xC ), LCD_UTF8_ASCII( base + 0xD ), LCD_UTF8_ASCII( base + 0xE ), LCD_UTF8_ASCII( base + 0xF )
 
-#endif
+typedef struct
+{
+  uint16_t cp;
+  uint8_t  code;
+} LCD_UTF8_Map;
 
+#define LCD_UTF8_MAP_ROW( cp, a00, a02 )  { cp, LCD_UTF8_ROM( a00, a02 ) },
 
-/** Send a command to the LCD
-  *
-  * @param cmd: command byte to send; see HD44780 datasheet for details.
-  * @retval none
-  */
-static inline void LCD_Command( uint8_t cmd )
+static const    uint8_t   hd_utf8_ascii[ 128 ] =
 {
-  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+  LCD_UTF8_ROW16( 0x00 ), LCD_UTF8_ROW16( 0x10 ), LCD_UTF8_ROW16( 0x20 ), LCD_UTF8_ROW16( 0x30 ),
+  LCD_UTF8_ROW16( 0x40 ), LCD_UTF8_ROW16( 0x50 ), LCD_UTF8_ROW16( 0x60 ), LCD_UTF8_ROW16( 0x70 )
+};
 
-  LCD_SetRS( INSTR_REG );
-  LCD_SetRNW( WRITE );
+static const    LCD_UTF8_Map hd_utf8_map[] = { LCD_UTF8_CHARS( LCD_UTF8_MAP_ROW ) };
 
-  delay_cycles( E_CYCLES );
-  LCD_Output( cmd );
-  LCD_SetE( ENABLE );
-  delay_cycles( E_CYCLES );
-  LCD_SetE( DISABLE );
-  delay_cycles( E_CYCLES );
+#define LCD_UTF8_MAP_SIZE   ( sizeof( hd_utf8_map ) / sizeof( hd_utf8_map[ 0 ] ) )
 
-#ifdef LCD_BUS4BIT
+static          uint32_t  hd_utf8_cp      = 0;
+static          uint32_t  hd_utf8_min     = 0;
+static          uint8_t   hd_utf8_need    = 0;
 
-  LCD_Output( cmd << 4 );
-  LCD_SetE( ENABLE );
-  delay_cycles( E_CYCLES );
+#ifdef LCD_UTF8_CGRAM_FALLBACK
+
+#ifndef LCD_UDG_SUPPORT
+  #error LCD_UTF8_CGRAM_FALLBACK needs LCD_UDG_SUPPORT.
+#endif
+
+#if LCD_UTF8_CGRAM_SLOTS < 1 || LCD_UTF8_CGRAM_SLOTS > LCD_CGRAM_CHAR_SLOTS
+  #error LCD_UTF8_CGRAM_SLOTS must be between 1 and the number of CGRAM slots.
+#endif
+
+#define LCD_UTF8_CGRAM_FIRST        ( LCD_CGRAM_CHAR_SLOTS - LCD_UTF8_CGRAM_SLOTS )
+
+static struct
+{
+  uint16_t        cp;
+  const uint8_t * pattern;
+}                         hd_utf8_glyph[ LCD_UTF8_GLYPHS ];
+static          uint8_t   hd_utf8_slot[ LCD_UTF8_CGRAM_SLOTS ];     // Glyph index + 1, 0 when empty
+static          uint8_t   hd_utf8_slot_next = 0;
+#endif
+
+#endif
+
+
+/** Display shift tracking, the marquee and pages.
+  *
+  * hd_shift is the DDRAM column shown in the leftmost display column.
+  * Pages split each DDRAM line into screens of LCD_PAGE_STRIDE columns,
+  * the number of cells each line shows.  Linear single-row panels show
+  * them all on the first line.
+  */
+#if defined( LCD_MARQUEE_SUPPORT ) || defined( LCD_PAGE_SUPPORT )
+
+#if NUMLINES == TWOLINES
+  #define LCD_SHIFT_SPAN            LCD_DDRAM_LINE
+  #if defined( HD_PANEL_16X1_T2 ) || defined( HD_PANEL_24X1_T2 )
+    #define LCD_PAGE_STRIDE         ( XMAX + 1 )
+  #else
+    #define LCD_PAGE_STRIDE         ( ( XMAX + 1 ) * ( YMAX + 1 ) / 2 )
+  #endif
+#else
+  #define LCD_SHIFT_SPAN            LCD_DDRAM_CELLS
+  #define LCD_PAGE_STRIDE           ( ( XMAX + 1 ) * ( YMAX + 1 ) )
+#endif
+
+static          uint8_t   hd_shift        = 0;
+
+static void LCD_TrackShift( uint8_t cmd );
+
+#define LCD_TRACK_SHIFT( cmd )      LCD_TrackShift( cmd )
+#else
+#define LCD_TRACK_SHIFT( cmd )
+#endif
+
+#ifdef LCD_MARQUEE_SUPPORT
+static          uint8_t   hd_marquee_on   = 0;
+static          uint32_t  hd_marquee_last = 0;
+static          uint32_t  hd_marquee_us   = 0;
+#endif
+
+#ifdef LCD_PAGE_SUPPORT
+
+#define LCD_PAGES                   ( LCD_SHIFT_SPAN / LCD_PAGE_STRIDE )
+
+#if LCD_PAGES < 2
+  #error LCD_PAGE_SUPPORT needs a panel with off-screen DDRAM.
+#endif
+
+static          uint8_t   hd_page_draw    = 0;
+#endif
+
+
+/** Non-blocking power-up sequence state.
+  */
+#ifdef LCD_INIT_ASYNC_SUPPORT
+static          uint8_t   hd_init_step    = 0xFF;
+static          uint32_t  hd_init_due     = 0;
+#endif
+
+
+/** Pixel canvas state.
+  *
+  * hd_canvas is the drawing and hd_canvas_glass what CGRAM holds for the
+  * cells flagged in hd_canvas_known.
+  */
+#ifdef LCD_CANVAS_SUPPORT
+
+#ifndef LCD_UDG_SUPPORT
+  #error LCD_CANVAS_SUPPORT needs LCD_UDG_SUPPORT.
+#endif
+
+#define LCD_CANVAS_CELLS            ( LCD_CANVAS_COLS * LCD_CANVAS_ROWS )
+#define LCD_CANVAS_WIDTH            ( LCD_CANVAS_COLS * 5 )
+#define LCD_CANVAS_HEIGHT           ( LCD_CANVAS_ROWS * LCD_CGRAM_CHAR_ROWS )
+
+#if LCD_CANVAS_COLS < 1 || LCD_CANVAS_ROWS < 1 || LCD_CANVAS_FIRST + LCD_CANVAS_CELLS > LCD_CGRAM_CHAR_SLOTS
+  #error The LCD canvas does not fit in the CGRAM slots.
+#endif
+
+static          uint8_t   hd_canvas[ LCD_CANVAS_CELLS ][ LCD_CGRAM_CHAR_ROWS ];
+static          uint8_t   hd_canvas_glass[ LCD_CANVAS_CELLS ][ LCD_CGRAM_CHAR_ROWS ];
+static          uint8_t   hd_canvas_known = 0;
+
+/* A slot written outside the canvas no longer holds what hd_canvas_glass says. */
+#define LCD_CANVAS_FORGET( slot )   do { uint8_t cell_ = ( slot ) - LCD_CANVAS_FIRST; \
+                                         if( cell_ < LCD_CANVAS_CELLS ) hd_canvas_known &= ~( 1u << cell_ ); } while( 0 )
+#else
+#define LCD_CANVAS_FORGET( slot )
+#endif
+
+
+/** Animation state.
+  *
+  * delta[ n ] has a bit set for each row that differs between frame n
+  * and the frame before it, wrapping round to the last.
+  */
+#ifdef LCD_ANIM_SUPPORT
+
+#ifndef LCD_UDG_SUPPORT
+  #error LCD_ANIM_SUPPORT needs LCD_UDG_SUPPORT.
+#endif
+
+#define LCD_ANIM_FREE               0xFFu
+
+typedef struct
+{
+  const uint8_t * frames;
+  uint16_t        delta[ LCD_ANIM_FRAMES ];
+  uint32_t        last;
+  uint32_t        interval_us;
+  uint8_t         slot;
+  uint8_t         count;
+  uint8_t         frame;
+  uint8_t         due;
+} LCD_Anim;
+
+static          LCD_Anim  hd_anim[ LCD_ANIM_MAX ];
+
+static void LCD_AnimReset( void );
+#endif
+
+
+/** VT100 parser state and receive ring.
+  *
+  * The ring indices run freely; the interrupt handler only moves
+  * hd_vt_head and LCD_VT100_Service() only moves hd_vt_tail.
+  */
+#ifdef LCD_VT100_SUPPORT
+
+#if ( LCD_VT100_RX_SIZE & ( LCD_VT100_RX_SIZE - 1 ) ) != 0 || LCD_VT100_RX_SIZE > 32768
+  #error LCD_VT100_RX_SIZE must be a power of two no greater than 32768.
+#endif
+
+#define LCD_VT_GROUND               0u
+#define LCD_VT_ESCAPE               1u
+#define LCD_VT_CSI                  2u
+#define LCD_VT_CSI_IGNORE           3u    // Private or malformed, skip to the final byte
+#define LCD_VT_PARAMS               4u
+
+static          uint8_t   hd_vt_state     = LCD_VT_GROUND;
+static          uint8_t   hd_vt_param[ LCD_VT_PARAMS ];
+static          uint8_t   hd_vt_nparam    = 0;
+static          uint8_t   hd_vt_saved_x   = 0,
+                          hd_vt_saved_y   = 0;
+static          uint8_t   hd_vt_rx[ LCD_VT100_RX_SIZE ];
+static volatile uint16_t  hd_vt_head      = 0;
+static volatile uint16_t  hd_vt_tail      = 0;
+#endif
+
+
+/** Console state.
+  *
+  * Line hd_con_seq is the one being written, at hd_con_text[ hd_con_seq
+  * % LCD_CONSOLE_LINES ].  hd_con_count lines, including it, are kept.
+  * hd_con_row_* record what each panel row shows.
+  */
+#ifdef LCD_CONSOLE_SUPPORT
+
+#define LCD_CON_WIDTH               ( XMAX + 1 )
+#define LCD_CON_ROWS                ( YMAX + 1 )
+
+#define LCD_CON_ROW_UNKNOWN         0u
+#define LCD_CON_ROW_BLANK           1u
+#define LCD_CON_ROW_LINE            2u
+
+#if LCD_CONSOLE_LINES < LCD_CON_ROWS
+  #error LCD_CONSOLE_LINES must be at least the number of panel rows.
+#endif
+
+static          uint8_t   hd_con_text[ LCD_CONSOLE_LINES ][ LCD_CON_WIDTH ];
+static          uint32_t  hd_con_seq      = 0;
+static          uint16_t  hd_con_count    = 1;
+static          uint16_t  hd_con_back     = 0;
+static          uint8_t   hd_con_col      = 0;
+static          uint8_t   hd_con_flags    = LCD_CONSOLE_ORDERED;
+static          uint8_t   hd_con_row_state[ LCD_CON_ROWS ];
+static          uint32_t  hd_con_row_seq[ LCD_CON_ROWS ];
+#endif
+
+
+/** Current screen template.
+  */
+#ifdef LCD_SCREEN_SUPPORT
+
+#ifndef LCD_FRAMEBUFFER_SUPPORT
+  #error LCD_SCREEN_SUPPORT needs LCD_FRAMEBUFFER_SUPPORT.
+#endif
+
+static const    LCD_Screen * hd_screen    = NULL;
+#endif
+
+
+/** Widget state.
+  *
+  * hd_widget_set is the set of custom characters in CGRAM slots 0 to 6.
+  */
+#ifdef LCD_WIDGET_SUPPORT
+
+#ifndef LCD_UDG_SUPPORT
+  #error LCD_WIDGET_SUPPORT needs LCD_UDG_SUPPORT.
+#endif
+
+#if LCD_CHAR_FONT != LCD_CHAR_FONT_5X8
+  #error LCD_WIDGET_SUPPORT needs the 5x8 font.
+#endif
+
+#define LCD_WIDGET_SET_NONE         0u
+#define LCD_WIDGET_SET_HBAR         1u
+#define LCD_WIDGET_SET_VBAR         2u
+#define LCD_WIDGET_SET_BIGNUM       3u
+
+#define LCD_BAR_UNKNOWN             0xFFFFu
+#define LCD_BIG_UNKNOWN             0xFFu
+#define LCD_BIG_BLANK               10u
+
+static          uint8_t   hd_widget_set   = LCD_WIDGET_SET_NONE;
+#endif
+
+
+/** DMA waveform state.
+  *
+  * hd_wave holds GPIO BSRR words: pins to set in the low half, pins to
+  * reset in the high half, 0 to leave the bus alone for a tick.
+  */
+#ifdef LCD_WAVE_SUPPORT
+
+#if LCD_WAVE_TICK_NS < 250
+  #error LCD_WAVE_TICK_NS must be at least 250 for the E pulse width.
+#endif
+
+#define LCD_WAVE_TICKS( us )        ( ( ( us ) * 1000u + LCD_WAVE_TICK_NS - 1u ) / LCD_WAVE_TICK_NS )
+#define LCD_WAVE_E_HIGH             ( ( uint32_t )LCD_E )
+#define LCD_WAVE_E_LOW              ( ( uint32_t )LCD_E << 16 )
+
+static          uint32_t  hd_wave[ LCD_WAVE_WORDS ];
+static          uint16_t  hd_wave_len     = 0;
+static volatile uint8_t   hd_wave_busy    = 0;
+static void   ( * volatile hd_wave_done )( void ) = NULL;
+
+/* Tracking as it stood before the first append, put back if the
+   waveform is dropped without playing, and the cells it writes. */
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+static          uint8_t   hd_wave_fb_entry;
+static          uint8_t   hd_wave_cells[ ( LCD_DDRAM_CELLS + 7u ) / 8u ];
+#endif
+#ifdef LCD_RECOVER_SUPPORT
+static          uint8_t   hd_wave_disp_ctrl;
+static          uint8_t   hd_wave_entry_mode;
+#endif
+#if defined( LCD_MARQUEE_SUPPORT ) || defined( LCD_PAGE_SUPPORT )
+static          uint8_t   hd_wave_shift;
+#endif
+#ifdef LCD_PAGE_SUPPORT
+static          uint8_t   hd_wave_page_draw;
+#endif
+#ifdef LCD_RIGHT_ALIGN_SUPPORT
+static          uint8_t   hd_wave_right_dec;
+#endif
+#endif
+
+
+/** Driver-held controller state for LCD_Recover().
+  */
+#ifdef LCD_RECOVER_SUPPORT
+static          uint8_t   hd_disp_ctrl    = DISP_CTRL | DISP | CURSOR | BLINK;
+static          uint8_t   hd_entry_mode   = ENT_MODE | INC;
+#ifdef LCD_UDG_SUPPORT
+static          uint8_t   hd_cgram_shadow[ LCD_CGRAM_CHAR_SLOTS ][ LCD_CGRAM_CHAR_ROWS ];
+static          uint8_t   hd_cgram_valid  = 0;
+#endif
+
+static void LCD_TrackModes( uint8_t cmd );
+
+#define LCD_TRACK_MODES( cmd )      LCD_TrackModes( cmd )
+#else
+#define LCD_TRACK_MODES( cmd )
+#endif
+
+
+/** Right-aligned writer state.
+  *
+  * hd_right_dec is set while the controller is left in decrementing
+  * entry mode, and hd_right_own while LCD_PutNumberRight() is writing.
+  * Any other data write puts the incrementing mode back first.
+  */
+#ifdef LCD_RIGHT_ALIGN_SUPPORT
+static          uint8_t   hd_right_dec    = 0;
+static          uint8_t   hd_right_own    = 0;
+
+static void LCD_TrackEntry( uint8_t cmd );
+static void LCD_EntryRestore( void );
+
+#define LCD_TRACK_ENTRY( cmd )      LCD_TrackEntry( cmd )
+#define LCD_ENTRY_RESTORE()         LCD_EntryRestore()
+#else
+#define LCD_TRACK_ENTRY( cmd )
+#define LCD_ENTRY_RESTORE()
+#endif
+
+
+/** VFD has four different intensities VFD25 VFD50 VFD75 and VFD100
+  *
+  * Brightness will vary from 25% to 100%
+  */
+#ifdef HD_ISVFD
+char vfd_intensity = VFD100;
+#endif
+
+ 
+// HACK: Time wasting routine.  It was being optimised away until it's parameters were declared
+// volatile.  This comes from use in CCS C which has this as a built-in, but they mean machine
+// cycles.
+//
+void delay_cycles( volatile uint8_t cycles_to_waste )
+{
+  while( cycles_to_waste-- );
+}
+
+
+/** Bus delays, tuned at run time or fixed at E_CYCLES.
+  */
+#ifdef LCD_TUNE_SUPPORT
+
+#ifndef LCD_RECOVER_SUPPORT
+  #error LCD_TUNE_SUPPORT needs LCD_RECOVER_SUPPORT.
+#endif
+#ifndef LCD_READ_DD_SUPPORT
+  #error LCD_TUNE_SUPPORT needs LCD_READ_DD_SUPPORT.
+#endif
+
+#define LCD_TUNE_CELLS              8u
+
+static          LCD_Timing hd_timing      = { E_CYCLES, E_CYCLES, E_CYCLES };
+
+#define LCD_SETUP_CYCLES            hd_timing.setup
+#define LCD_PULSE_CYCLES            hd_timing.pulse
+#define LCD_HOLD_CYCLES             hd_timing.hold
+#else
+#define LCD_SETUP_CYCLES            E_CYCLES
+#define LCD_PULSE_CYCLES            E_CYCLES
+#define LCD_HOLD_CYCLES             E_CYCLES
+#endif
+
+
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_BUSY_HIST )
+
+/** Record the number of busy polls taken by one busy wait.
+  *
+  * @param iterations: polls that found the controller busy
+  * @retval none
+  */
+static void LCD_StatBusyIterations( uint32_t iterations )
+{
+  uint8_t bucket = 0;
+
+  if( iterations > hd_stats.busy_wait_max ) hd_stats.busy_wait_max = iterations;
+
+  while( iterations && bucket < LCD_STATS_HIST_BUCKETS - 1 )
+  {
+    iterations >>= 1;
+    bucket++;
+  }
+  hd_stats.busy_wait_hist[ bucket ]++;
+}
+#endif
+
+
+#if defined( LCD_STATS_SUPPORT ) && defined( LCD_STATS_BLOCKED_TIME )
+
+/** Charge time spent in a busy wait to the operation that caused it.
+  *
+  * @param elapsed_us: microseconds spent waiting
+  * @retval none
+  */
+static void LCD_StatBlocked( uint32_t elapsed_us )
+{
+  hd_stats.blocked_us += elapsed_us;
+  hd_stats.blocked_us_by_class[ hd_stat_class ] += elapsed_us;
+}
+#endif
+
+
+#ifdef LCD_TRACE_SUPPORT
+
+/** Append a transaction to the trace ring.
+  *
+  * @param flags: LCD_TRACE_* flags describing the transaction
+  * @param value: byte written or read
+  * @retval none
+  */
+static void LCD_TraceRecord( uint8_t flags, uint8_t value )
+{
+  LCD_TraceEntry * entry;
+
+  if( !hd_trace_on ) return;
+
+  entry = &hd_trace[ hd_trace_head ];
+  entry->timestamp = LCD_Time_us();
+  entry->flags     = flags;
+  entry->value     = value;
+  entry->polls     = 0;
+
+  hd_trace_head = ( hd_trace_head + 1 ) & ( LCD_TRACE_DEPTH - 1 );
+  if( hd_trace_count < LCD_TRACE_DEPTH ) hd_trace_count++;
+}
+
+
+/** Record a busy flag read, folding it into the previous entry if that
+  * was also a busy flag read.
+  *
+  * @param busy: state of the busy flag
+  * @retval none
+  */
+static void LCD_TracePoll( uint8_t busy )
+{
+  LCD_TraceEntry * last;
+
+  if( !hd_trace_on ) return;
+
+  last = &hd_trace[ ( hd_trace_head - 1 ) & ( LCD_TRACE_DEPTH - 1 ) ];
+
+  if( hd_trace_count == 0 || last->flags != ( LCD_TRACE_BUSY | LCD_TRACE_READ | LCD_TRACE_PHASE ) )
+  {
+    LCD_TraceRecord( LCD_TRACE_BUSY | LCD_TRACE_READ | LCD_TRACE_PHASE, 0 );
+    last = &hd_trace[ ( hd_trace_head - 1 ) & ( LCD_TRACE_DEPTH - 1 ) ];
+  }
+
+  last->value = busy ? BF : 0;
+  if( last->polls < UINT16_MAX ) last->polls++;
+}
+#endif
+
+
+/** Set the RS pin state
+  *
+  * @param state: 1 = Data Register, 0 = Instruction Register
+  * @retval none
+  */
+static inline void LCD_SetRS(uint8_t state)
+{
+  Output_Pin( LCD_RS, LCD_RS_BANK, state );
+  delay_cycles( LCD_SETUP_CYCLES );
+}
+
+
+/** Set the Read/Write pin state
+  *
+  * @param state: 1 = Read, 0 = Write
+  * @retval none
+  */
+static inline void LCD_SetRNW(uint8_t state)
+{
+  Output_Pin( LCD_RNW, LCD_RNW_BANK, state );
+  delay_cycles( LCD_SETUP_CYCLES );
+}
+
+
+/** Set the Enable pin state
+  *
+  * @param state: 1 = Enable, 0 = Disable
+  * @retval none
+  */
+static inline void LCD_SetE( uint8_t state )
+{
+  Output_Pin( LCD_E, LCD_E_BANK, state );
+  if( state == ENABLE ) { LCD_STAT_STROBE(); }
+  delay_cycles( ( state == ENABLE ) ? LCD_PULSE_CYCLES : LCD_HOLD_CYCLES );
+}
+
+
+/* Set the LCD bus to input mode 
+ *
+ * @param none
+ * @retval none
+ */
+static inline void LCD_SetBusInput( void )
+{
+  LCD_STAT_BUS_INPUT();
+
+  Set_Input_Pin( LCD_D7, LCD_D7_BANK );
+  Set_Input_Pin( LCD_D6, LCD_D6_BANK );
+  Set_Input_Pin( LCD_D5, LCD_D5_BANK );
+  Set_Input_Pin( LCD_D4, LCD_D4_BANK );
+
+#ifdef LCD_BUS8BIT
+  Set_Input_Pin( LCD_D3, LCD_D3_BANK );
+  Set_Input_Pin( LCD_D2, LCD_D2_BANK );
+  Set_Input_Pin( LCD_D1, LCD_D1_BANK );
+  Set_Input_Pin( LCD_D0, LCD_D0_BANK );
+#endif
+}
+
+
+/** Read the LCD bus input  
+  *
+  * @param none
+  * @retval byte read from the LCD bus
+  */
+static inline uint8_t LCD_Input( void )
+{
+  uint8_t ch;
+
+  LCD_SetBusInput();
+
+  ch  = Read_Pin( LCD_D7, LCD_D7_BANK ); ch <<= 1;
+  ch |= Read_Pin( LCD_D6, LCD_D6_BANK ); ch <<= 1;
+  ch |= Read_Pin( LCD_D5, LCD_D5_BANK ); ch <<= 1;
+  ch |= Read_Pin( LCD_D4, LCD_D4_BANK );
+
+#ifdef LCD_BUS8BIT
+  ch <<= 1;
+  ch |= Read_Pin( LCD_D3, LCD_D3_BANK ); ch <<= 1;
+  ch |= Read_Pin( LCD_D2, LCD_D2_BANK ); ch <<= 1;
+  ch |= Read_Pin( LCD_D1, LCD_D1_BANK ); ch <<= 1;
+  ch |= Read_Pin( LCD_D0, LCD_D0_BANK );
+#endif
+
+  return ch;
+}
+
+
+/* Output to LCD bus
+ * @param ch: byte to output to the LCD bus
+ *
+ * @retval none
+ */
+static inline void LCD_Output( uint8_t ch )
+{
+  LCD_OutputUpperNibble( ch );
+#ifdef LCD_BUS8BIT
+  LCD_OutputLowerNibble( ch );
+#endif
+}
+
+
+/* Output only the upper nibble (D7..D4) to the LCD bus.
+ * Useful during 4-bit startup when the controller has not yet latched 4-bit mode.
+ */
+static inline void LCD_OutputUpperNibble( uint8_t ch )
+{
+  LCD_STAT_BUS_OUTPUT();
+
+  Output_Pin( LCD_D7, LCD_D7_BANK, ch & 0x80 );
+  Output_Pin( LCD_D6, LCD_D6_BANK, ch & 0x40 );
+  Output_Pin( LCD_D5, LCD_D5_BANK, ch & 0x20 );
+  Output_Pin( LCD_D4, LCD_D4_BANK, ch & 0x10 );
+}
+
+
+/* Clock one bootstrap write during initialisation.
+ * In 4-bit mode only D7..D4 are driven as the controller has not yet
+ * latched its bus width.
+ */
+static inline void LCD_InitWrite( uint8_t ch )
+{
+  LCD_TRACE_INIT( ch );
+
+#ifdef LCD_BUS4BIT
+  LCD_OutputUpperNibble( ch );
+#else
+  LCD_Output( ch );
+#endif
+  LCD_SetE( ENABLE );
+  LCD_SetE( DISABLE );
+  LCD_BUSY_MARK( LCD_BUSY_UNKNOWN );
+}
+
+
+#ifdef LCD_BUS8BIT
+/* Output only the lower nibble (D3..D0) to the LCD bus. */
+static inline void LCD_OutputLowerNibble( uint8_t ch )
+{
+  Output_Pin( LCD_D3, LCD_D3_BANK, ch & 0x08 );
+  Output_Pin( LCD_D2, LCD_D2_BANK, ch & 0x04 );
+  Output_Pin( LCD_D1, LCD_D1_BANK, ch & 0x02 );
+  Output_Pin( LCD_D0, LCD_D0_BANK, ch & 0x01 );
+}
+#endif
+
+
+/** Read the busy flag from the LCD
+  *
+  * @param none
+  * @retval uint8_t: busy flag state
+  */
+static inline uint8_t LCD_IsBusy( void )
+{
+  uint8_t busybit;
+
+  LCD_STAT_POLL();
+
+  /* Prep LCD for busy flag read */
+  LCD_SetBusInput();
+  LCD_SetRS( INSTR_REG );
+  LCD_SetRNW( READ );
+  LCD_SetE( ENABLE );
+  delay_cycles( LCD_PULSE_CYCLES );
+
+  /* Read busy flag */
+  busybit = Read_Pin( LCD_D7, LCD_D7_BANK );
+  LCD_TRACE_POLL( busybit );
+
+  /* Turn off the Enable pin */
+  LCD_SetE( DISABLE );
+  delay_cycles( LCD_HOLD_CYCLES );
+
+  /* Do it again for 4-bit mode, ignoring the result */
+#ifndef LCD_BUS8BIT
+  LCD_SetE( ENABLE );
+  delay_cycles( LCD_PULSE_CYCLES );
+  
+  LCD_SetE( DISABLE );
+  delay_cycles( LCD_HOLD_CYCLES );
+#endif
+  
+  return busybit;
+}
+
+
+#ifdef LCD_READ_DD_SUPPORT
+
+/** Read Display Data RAM at the specified address
+  *
+  * @param dd_read_addr: address to read from
+  * @retval uint8_t: data read from DDRAM
+  */
+uint8_t LCD_Read_DDRAM( uint8_t dd_read_addr, uint8_t * dd_data )
+{
+  if( dd_data == NULL ) return LCD_RESULT_ERROR;
+
+  if( hd_status & LCD_STATUS_TIMEOUT )
+  {
+    *dd_data = LCD_READ_FALLBACK_VALUE;
+    return LCD_RESULT_ERROR;
+  }
+
+  /* Set DDRAM address to read from */
+  LCD_Command( SET_DDRAM_ADD | dd_read_addr );
+  if( !LCD_BusyWait() )
+  {
+    *dd_data = LCD_READ_FALLBACK_VALUE;
+    return LCD_RESULT_ERROR;
+  }
+  LCD_STAT_CLASS( LCD_STAT_CLASS_READ );
+  LCD_SetRS( DATA_REG );
+  LCD_SetRNW( READ );
+
+  /* Prepare LCD for data read */
+  delay_cycles( LCD_SETUP_CYCLES );
+  LCD_SetE( ENABLE );
+  delay_cycles( LCD_PULSE_CYCLES );
+
+  /* Read data */
+  *dd_data = LCD_Input();
+
+  /* Turn off Enable pin */
+  LCD_SetE( DISABLE );
+  delay_cycles( LCD_HOLD_CYCLES );
+
+/* Read second nibble for 4-bit mode */
+#ifdef LCD_BUS4BIT
+  LCD_SetE( ENABLE );
+  delay_cycles( LCD_PULSE_CYCLES );
+  *dd_data <<= 4;
+  *dd_data |= LCD_Input();
+  LCD_SetE( DISABLE );
+  delay_cycles( LCD_HOLD_CYCLES );
+#endif  // LCD_READ_DD_SUPPORT 4-bit mode
+
+  LCD_TRACE( LCD_TRACE_RS | LCD_TRACE_READ, *dd_data );
+  LCD_TRACK_READ();
+  LCD_BUSY_MARK( LCD_BUSY_DATA_US );
+
+  return LCD_RESULT_OK;
+}
+#endif // LCD_READ_DD_SUPPORT
+
+
+#ifdef LCD_READCHAR_SUPPORT
+
+/** Read character at the display coordinates specified, with
+  * (0,0) being the top left of the display.
+  *
+  * @param rc_x: X coordinate to read from
+  * @param rc_y: Y coordinate to read from
+  * @retval uint8_t: character read from the specified location
+  */
+uint8_t LCD_Readchar( uint8_t rc_x, uint8_t rc_y, uint8_t * rc_data )
+{
+  int addr_to_sample;
+
+  if( rc_data == NULL ) return LCD_RESULT_ERROR;
+
+  addr_to_sample = LCD_DDRAM_Addr( rc_x, rc_y );
+
+  return LCD_Read_DDRAM( addr_to_sample, rc_data );
+}
+
+#endif
+
+
+/** Send a command to the LCD
+  *
+  * @param cmd: command byte to send; see HD44780 datasheet for details.
+  * @retval none
+  */
+static inline void LCD_Command( uint8_t cmd )
+{
+  /* A data write may still be running. */
+  LCD_BUSY_SETTLE();
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  LCD_STAT_COMMAND();
+  LCD_STAT_CLASS( ( cmd & ~( CLR_DISP | RET_HOME ) ) ? LCD_STAT_CLASS_COMMAND : LCD_STAT_CLASS_CLEAR );
+  LCD_TRACE( 0, cmd );
+  LCD_TRACK_COMMAND( cmd );
+  LCD_TRACK_MODES( cmd );
+  LCD_TRACK_SHIFT( cmd );
+  LCD_TRACK_ENTRY( cmd );
+
+  LCD_SetRS( INSTR_REG );
+  LCD_SetRNW( WRITE );
+
+  delay_cycles( LCD_SETUP_CYCLES );
+  LCD_Output( cmd );
+  LCD_SetE( ENABLE );
+  delay_cycles( LCD_PULSE_CYCLES );
+  LCD_SetE( DISABLE );
+  delay_cycles( LCD_HOLD_CYCLES );
+
+#ifdef LCD_BUS4BIT
+
+  LCD_Output( cmd << 4 );
+  LCD_SetE( ENABLE );
+  delay_cycles( LCD_PULSE_CYCLES );
+  LCD_SetE( DISABLE );
+  delay_cycles( LCD_HOLD_CYCLES );
+
+#endif
+
+  LCD_Input();
+  LCD_BUSY_MARK( ( cmd & ~( CLR_DISP | RET_HOME ) ) ? LCD_BUSY_EXEC_US : LCD_BUSY_CLEAR_US );
+
+  /* With adaptive waiting the next transfer waits for this one instead,
+     leaving the CPU free while the instruction runs. */
+#ifndef LCD_BUSY_ADAPTIVE_SUPPORT
+  LCD_BusyWait();
+#endif
+}
+
+
+#if defined( LCD_BUSY_ADAPTIVE_SUPPORT ) || ( defined( LCD_RECOVER_SUPPORT ) && defined( LCD_BUS4BIT ) )
+
+/** Spin for a number of microseconds.  Also used by LCD_Recover() while
+  * the bus mode is still unknown.
+  *
+  * @param us: microseconds to wait
+  * @retval none
+  */
+static void LCD_BusyPause( uint32_t us )
+{
+  uint32_t started = LCD_Time_us();
+
+  while( LCD_Time_us() - started < us );
+}
+
+#endif
+
+
+#ifdef LCD_BUSY_ADAPTIVE_SUPPORT
+
+
+/** Decide how a busy wait should start.
+  *
+  * Nothing needs polling if the controller was last seen idle, or the
+  * last transfer's worst case has passed.  Otherwise most of its
+  * typical time is waited out here first.
+  *
+  * @retval uint32_t: first gap between polls in microseconds, or 0 if
+  *                   the controller is known to be idle
+  */
+static uint32_t LCD_BusyPrepare( void )
+{
+  uint32_t elapsed,
+           early;
+
+  if( hd_busy_exec == LCD_BUSY_UNKNOWN ) return 1;
+
+  elapsed = LCD_Time_us() - hd_busy_start;
+  if( elapsed >= ( uint32_t )hd_busy_exec * LCD_BUSY_WORST_PERCENT / 100u )
+  {
+    hd_busy_exec = 0;
+    return 0;
+  }
+
+  early = ( uint32_t )hd_busy_exec * LCD_BUSY_EARLY_PERCENT / 100u;
+  if( elapsed < early ) LCD_BusyPause( early - elapsed );
+
+  return 1;
+}
+
+#endif
+
+
+/** Waits until the LCD is no longer busy
+  *
+  * @param none
+  * @retval none
+  */
+static inline uint8_t LCD_BusyWait( void )
+{
+  unsigned long timeout_remaining = LCD_BUSY_WAIT_TIMEOUT;
+  uint32_t      busy_iterations   = 0;
+#ifdef LCD_BUSY_ADAPTIVE_SUPPORT
+  uint32_t      gap_us;
+#endif
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_BUSY_WAIT_FAILED;
+
+  LCD_STAT_WAIT_START();
+
+#ifdef LCD_BUSY_ADAPTIVE_SUPPORT
+  gap_us = LCD_BusyPrepare();
+  if( gap_us == 0 )
+  {
+    LCD_STAT_BUSY_ITERATIONS( 0 );
+    LCD_STAT_WAIT_END();
+    return LCD_BUSY_WAIT_COMPLETE;
+  }
+#endif
+
+  while( LCD_IsBusy() )
+  {
+    busy_iterations++;
+#ifdef LCD_BUSY_ADAPTIVE_SUPPORT
+    LCD_BusyPause( gap_us );
+    if( gap_us < LCD_BUSY_BACKOFF_MAX_US ) gap_us <<= 1;
+#endif
+#if LCD_BUSY_WAIT_TIMEOUT > 0
+    if( timeout_remaining == 0 )
+    {
+      hd_status |= LCD_STATUS_TIMEOUT;
+      LCD_STAT_TIMEOUT();
+      LCD_STAT_BUSY_ITERATIONS( busy_iterations );
+      LCD_STAT_WAIT_END();
+      return LCD_BUSY_WAIT_FAILED;
+    }
+    timeout_remaining--;
+#endif
+  }
+
+  LCD_STAT_BUSY_ITERATIONS( busy_iterations );
+  LCD_STAT_WAIT_END();
+  ( void )busy_iterations;
+#ifdef LCD_BUSY_ADAPTIVE_SUPPORT
+  hd_busy_exec = 0;
+#endif
+
+  return LCD_BUSY_WAIT_COMPLETE;
+}
+
+
+#ifdef LCD_UDG_SUPPORT
+
+/** Define a user-defined character
+  *
+  * @param ChToSet: character code to define (0-7)
+  * @param ChDataset: pointer to character data (8 bytes, read-only)
+  * @retval none
+  */
+void LCD_Defchar( uint16_t ChToSet, const uint8_t * ChDataset )
+{
+  uint16_t ChAddress,
+      ch_line,
+      defchar_dd_addr;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+  if( ChDataset == NULL ) return;
+  if( ChToSet >= LCD_CGRAM_CHAR_SLOTS ) return;
+   
+  ChAddress = ChToSet * LCD_CGRAM_CHAR_STRIDE;  // Calculate address to UDG
+
+  /* The address counter only reads true once the last instruction is done. */
+  if( !LCD_BusyWait() ) return;
+
+  LCD_SetRS( INSTR_REG );
+  LCD_SetRNW( READ );
+  LCD_SetE( ENABLE );
+  defchar_dd_addr = LCD_Input() & 0b1111111;
+  LCD_SetE( DISABLE );
+  delay_cycles( LCD_HOLD_CYCLES );
+
+#ifdef LCD_BUS4BIT
+
+  defchar_dd_addr <<= 4;
+  LCD_SetE( ENABLE );
+  defchar_dd_addr |= LCD_Input() & 0b1111111;
   LCD_SetE( DISABLE );
-  delay_cycles( E_CYCLES );
+  delay_cycles( LCD_HOLD_CYCLES );
+
+#endif
+
+  LCD_TRACE( LCD_TRACE_READ, defchar_dd_addr );
+
+#ifdef LCD_RECOVER_SUPPORT
+  for( ch_line = 0; ch_line < LCD_CGRAM_CHAR_ROWS; ch_line++ )
+  {
+    hd_cgram_shadow[ ChToSet ][ ch_line ] = ChDataset[ ch_line ];
+  }
+  hd_cgram_valid |= 1u << ChToSet;
+#endif
+#ifdef LCD_WIDGET_SUPPORT
+  hd_widget_set = LCD_WIDGET_SET_NONE;
+#endif
+  LCD_CANVAS_FORGET( ChToSet );
+
+  LCD_Command(SET_CGRAM_ADD | ChAddress );
+  
+  for( ch_line = 0; ch_line < LCD_CGRAM_CHAR_ROWS; ch_line++ )
+  {
+    LCD_PutData( *ChDataset );
+    ChDataset++;
+  }
+
+  for( ; ch_line < LCD_CGRAM_CHAR_STRIDE; ch_line++ )
+  {
+    LCD_PutData( 0x00 );
+  }
+  
+  if( !LCD_BusyWait() ) return;
+  LCD_Command( SET_DDRAM_ADD | defchar_dd_addr );
+}
+
+#endif
+
+
+/** Write one character cell at a DDRAM address.
+  *
+  * Goes to the frame buffer in presentation mode, otherwise to the display.
+  *
+  * @param addr: DDRAM address of the cell
+  * @param ch: character to write
+  * @retval none
+  */
+static void LCD_WriteCell( uint8_t addr, uint8_t ch )
+{
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  uint8_t cell = LCD_CellIndex( addr );
+
+#ifdef LCD_PRESENT_SUPPORT
+  if( hd_presenting )
+  {
+    hd_fb_frame[ cell ] = ch;
+    return;
+  }
+#endif
+
+  /* Already on the glass, so only the frame needs to agree. */
+  if( cell != LCD_CELL_UNKNOWN && LCD_GLASS_IS( cell, ch ) )
+  {
+    hd_fb_frame[ cell ] = ch;
+    LCD_STAT_SKIPPED( 1 );
+    return;
+  }
+#endif
+
+  LCD_Command( SET_DDRAM_ADD | addr );
+  LCD_PutData( ch );
+}
+
+
+/** Point the controller's address counter at the driver cursor.
+  *
+  * Not needed in presentation mode as LCD_Flush() restores it.
+  *
+  * @retval none
+  */
+static void LCD_SyncCursor( void )
+{
+#ifdef LCD_PRESENT_SUPPORT
+  if( hd_presenting ) return;
+#endif
+
+  LCD_Command( SET_DDRAM_ADD | LCD_DDRAM_Addr( hd_xpos, hd_ypos ) );
+}
+
+
+#if defined( LCD_SCROLL_SUPPORT ) || defined( LCD_VIEWPORT_SUPPORT )
+/** Read one character cell.
+  *
+  * Comes from the frame buffer in presentation mode, from the driver's
+  * copy of the glass when there is one, otherwise from the display.
+  *
+  * @param x: X coordinate
+  * @param y: Y coordinate
+  * @param ch: destination for the character
+  * @retval uint8_t: LCD_RESULT_OK or LCD_RESULT_ERROR
+  */
+static uint8_t LCD_ReadCell( uint8_t x, uint8_t y, uint8_t * ch )
+{
+#ifdef LCD_PRESENT_SUPPORT
+  if( hd_presenting )
+  {
+    *ch = LCD_FB_Getc( x, y );
+    return LCD_RESULT_OK;
+  }
+#endif
+
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_RESULT_ERROR;
+
+  uint8_t cell = LCD_CellIndex( LCD_DDRAM_Addr( x, y ) );
+
+  *ch = LCD_GLASS_STALE( cell ) ? hd_fb_frame[ cell ] : hd_fb_glass[ cell ];
+  return LCD_RESULT_OK;
+#else
+  return LCD_Readchar( x, y, ch );
+#endif
+}
+#endif
+
+
+/** Move the cursor to the specified coordinates
+  *
+  * @param x: X coordinate (0 to XMAX)
+  * @param y: Y coordinate (0 to YMAX)
+  * @retval none
+  */
+void LCD_Locate( uint8_t x, uint8_t y )
+{
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  uint8_t addr = LCD_DDRAM_Addr( x, y );
+  hd_xpos = x; hd_ypos = y;
+  hd_wrap_pending = 0;
+
+#ifdef LCD_PRESENT_SUPPORT
+  if( hd_presenting ) return;
+#endif
+  
+  LCD_Command( SET_DDRAM_ADD | addr );
+}
+
+
+/** Write data to the LCD
+  *
+  * @param dat: data byte to write
+  * @retval none
+  */
+void LCD_PutData( uint8_t dat )
+{
+  if( !LCD_BusyWait() ) return;
+    LCD_ENTRY_RESTORE();
+    LCD_STAT_DATA();
+    LCD_STAT_CLASS( LCD_STAT_CLASS_DATA );
+    LCD_TRACE( LCD_TRACE_RS, dat );
+    LCD_TRACK_DATA( dat );
+    LCD_SetRS( DATA_REG );
+    LCD_SetRNW( WRITE );
+    delay_cycles( LCD_SETUP_CYCLES );
+    LCD_Output( dat );
+    LCD_SetE( ENABLE );
+    delay_cycles( LCD_PULSE_CYCLES );
+    LCD_SetE( DISABLE );
+    delay_cycles( LCD_HOLD_CYCLES );
+
+#ifdef LCD_BUS4BIT
+
+    LCD_Output( dat << 4 );
+    LCD_SetE( ENABLE );
+    delay_cycles( LCD_PULSE_CYCLES );
+    LCD_SetE( DISABLE );
+    delay_cycles( LCD_HOLD_CYCLES );
+
+#endif
+
+    LCD_Input();
+    LCD_BUSY_MARK( LCD_BUSY_DATA_US );
+
+}
+
+
+
+/** Scroll the display up one line, this is only available if enabled.
+  *
+  * @param none
+  * @retval none
+  */
+#ifdef LCD_SCROLL_SUPPORT
+
+void LCD_ScrollUp( void )
+{
+  uint8_t  line_pos,
+        line,
+        ch_moving,
+        new_addr;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+  hd_wrap_pending = 0;
+
+/* Don't scroll if there is only one line */
+   if( YMAX == 0 ) return;
+
+/* Make a copy one line up */
+  for( line = 1; line <= YMAX; line++)
+    for( line_pos = 0; line_pos <= XMAX; line_pos++ )
+    {
+      if( !LCD_ReadCell( line_pos, line, &ch_moving ) ) return;
+      new_addr = LCD_DDRAM_Addr( line_pos, line - 1 );
+      LCD_WriteCell( new_addr, ch_moving );
+    }
+  
+  /* Clear the last line */
+  for(line_pos = 0; line_pos <= XMAX; line_pos++)
+  {
+    LCD_WriteCell( LCD_DDRAM_Addr( line_pos, YMAX ), 0x20 );
+  }
+}
+#endif
+
+
+/** Get the DDRAM address for the specified coordinates
+  *
+  * @param dd_x: X coordinate (0 to XMAX)
+  * @param dd_y: Y coordinate (0 to YMAX)
+  * @retval uint8_t: DDRAM address for the specified coordinates
+  */
+uint8_t LCD_DDRAM_Addr( uint8_t dd_x, uint8_t dd_y )
+{  
+  /* Clamp coordinates to valid range to avoid indexing hd_map out-of-bounds. */
+  if( dd_x > XMAX ) dd_x = XMAX;
+  if( dd_y > YMAX ) dd_y = YMAX;
+
+#ifdef LCD_PAGE_SUPPORT
+  if( hd_page_draw )
+  {
+    uint8_t addr = hd_map[ dd_x + ( XMAX + 1 ) * dd_y ],
+            base = ( NUMLINES == TWOLINES ) ? ( addr & 0x40 ) : 0;
+
+    return base | ( ( addr - base + hd_page_draw * LCD_PAGE_STRIDE ) % LCD_SHIFT_SPAN );
+  }
+#endif
+
+  return ( hd_map[ dd_x + ( XMAX + 1 ) * dd_y ] );
+}
+
+
+
+#define LCD_Putc( ch_to_put ) LCD_Putchar( ch_to_put );
+
+
+#ifdef LCD_UTF8_SUPPORT
+
+/** Return the code to show for a character missing from the ROM.
+  *
+  * @param cp: Unicode code point
+  * @retval uint8_t: CGRAM code of a registered glyph, loading it first
+  *                  if needed, else LCD_UTF8_REPLACEMENT
+  */
+static uint8_t LCD_UTF8_Fallback( uint32_t cp )
+{
+#ifdef LCD_UTF8_CGRAM_FALLBACK
+  uint8_t glyph,
+          slot;
+
+  for( glyph = 0; glyph < LCD_UTF8_GLYPHS; glyph++ )
+  {
+    if( hd_utf8_glyph[ glyph ].pattern != NULL && hd_utf8_glyph[ glyph ].cp == cp ) break;
+  }
+  if( glyph == LCD_UTF8_GLYPHS ) return LCD_UTF8_REPLACEMENT;
+
+  for( slot = 0; slot < LCD_UTF8_CGRAM_SLOTS; slot++ )
+  {
+    if( hd_utf8_slot[ slot ] == glyph + 1 ) return LCD_UTF8_CGRAM_FIRST + slot;
+  }
+
+  slot = hd_utf8_slot_next;
+  hd_utf8_slot_next = ( slot + 1 ) % LCD_UTF8_CGRAM_SLOTS;
+  hd_utf8_slot[ slot ] = glyph + 1;
+  LCD_Defchar( LCD_UTF8_CGRAM_FIRST + slot, hd_utf8_glyph[ glyph ].pattern );
+
+  return LCD_UTF8_CGRAM_FIRST + slot;
+#else
+  ( void )cp;
+  return LCD_UTF8_REPLACEMENT;
+#endif
+}
+
+
+/** Find the ROM code for a code point outside ASCII.
+  *
+  * @param cp: Unicode code point
+  * @retval uint8_t: character code to send
+  */
+static uint8_t LCD_UTF8_Lookup( uint32_t cp )
+{
+  uint8_t low  = 0,
+          high = LCD_UTF8_MAP_SIZE,
+          mid;
+
+  while( low < high )
+  {
+    mid = ( low + high ) / 2;
+
+    if( hd_utf8_map[ mid ].cp < cp )
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+
+  if( low < LCD_UTF8_MAP_SIZE && hd_utf8_map[ low ].cp == cp && hd_utf8_map[ low ].code )
+  {
+    return hd_utf8_map[ low ].code;
+  }
+
+  if( cp >= LCD_UTF8_RAW_FIRST && cp <= LCD_UTF8_RAW_FIRST + 0xFF ) return ( uint8_t )cp;
+  if( cp >= LCD_UTF8_RANGE_FIRST && cp <= LCD_UTF8_RANGE_LAST ) return ( uint8_t )( cp - LCD_UTF8_RANGE_OFFSET );
+
+  return LCD_UTF8_Fallback( cp );
+}
+
+
+/** Feed one byte of UTF-8 through the decoder.
+  *
+  * ASCII costs one table lookup.  A malformed sequence shows as
+  * LCD_UTF8_REPLACEMENT, and a byte that cuts a sequence short is then
+  * decoded in its own right.
+  *
+  * @param byte: next byte of the string
+  * @param codes: receives up to two character codes to send
+  * @retval uint8_t: number of codes written to codes
+  */
+static uint8_t LCD_UTF8_Translate( uint8_t byte, uint8_t * codes )
+{
+  uint8_t count = 0;
+
+  if( hd_utf8_need )
+  {
+    if( ( byte & 0xC0 ) == 0x80 )
+    {
+      hd_utf8_cp = ( hd_utf8_cp << 6 ) | ( byte & 0x3F );
+      if( --hd_utf8_need ) return 0;
+
+      codes[ 0 ] = ( hd_utf8_cp < hd_utf8_min ) ? LCD_UTF8_REPLACEMENT : LCD_UTF8_Lookup( hd_utf8_cp );
+      return 1;
+    }
+
+    hd_utf8_need = 0;
+    codes[ count++ ] = LCD_UTF8_REPLACEMENT;
+  }
+
+  if( byte < 0x80 )
+  {
+    codes[ count ] = hd_utf8_ascii[ byte ];
+    if( !codes[ count ] && byte ) codes[ count ] = LCD_UTF8_Fallback( byte );
+    return count + 1;
+  }
+
+  if( byte >= 0xC2 && byte <= 0xDF )
+  {
+    hd_utf8_cp   = byte & 0x1F;
+    hd_utf8_need = 1;
+    hd_utf8_min  = 0x80;
+  }
+  else if( byte >= 0xE0 && byte <= 0xEF )
+  {
+    hd_utf8_cp   = byte & 0x0F;
+    hd_utf8_need = 2;
+    hd_utf8_min  = 0x800;
+  }
+  else if( byte >= 0xF0 && byte <= 0xF4 )
+  {
+    hd_utf8_cp   = byte & 0x07;
+    hd_utf8_need = 3;
+    hd_utf8_min  = 0x10000;
+  }
+  else
+  {
+    codes[ count++ ] = LCD_UTF8_REPLACEMENT;
+  }
+
+  return count;
+}
+
+
+#ifdef LCD_UTF8_CGRAM_FALLBACK
+
+/** Register a custom glyph for a code point the ROM lacks.
+  *
+  * The pattern is not copied, so it may stay in flash.  It is loaded
+  * into one of the top LCD_UTF8_CGRAM_SLOTS CGRAM slots when first
+  * shown, evicting the oldest glyph there if needed.
+  *
+  * @param cp: Unicode code point
+  * @param pattern: LCD_CGRAM_CHAR_ROWS bytes, as for LCD_Defchar()
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if the table is full
+  */
+uint8_t LCD_UTF8_AddGlyph( uint16_t cp, const uint8_t * pattern )
+{
+  uint8_t glyph;
+
+  if( pattern == NULL ) return LCD_RESULT_ERROR;
+
+  for( glyph = 0; glyph < LCD_UTF8_GLYPHS; glyph++ )
+  {
+    if( hd_utf8_glyph[ glyph ].pattern == NULL || hd_utf8_glyph[ glyph ].cp == cp ) break;
+  }
+  if( glyph == LCD_UTF8_GLYPHS ) return LCD_RESULT_ERROR;
+
+  hd_utf8_glyph[ glyph ].cp      = cp;
+  hd_utf8_glyph[ glyph ].pattern = pattern;
+
+  return LCD_RESULT_OK;
+}
+
+#endif
+
+#endif
+
+
+/* Non stdio.h version of putchar 
+ * for use with compilers like CCS C
+ *
+ * @brief Write a character to the LCD
+ *
+ * @param ch_to_put: character to write
+ * @retval none
+ */
+uint8_t LCD_Putchar( uint8_t ch )
+{
+#ifdef LCD_UTF8_SUPPORT
+  uint8_t codes[ 2 ],
+          count,
+          index;
+
+  count = LCD_UTF8_Translate( ch, codes );
+  for( index = 0; index < count; index++ ) LCD_PutCode( codes[ index ] );
+#else
+  LCD_PutCode( ch );
+#endif
+
+  return ch;
+}
+
+
+/** Write one character code to the LCD at the cursor.
+  *
+  * @param ch: character code, already translated for the ROM
+  * @retval uint8_t: the character written
+  */
+static uint8_t LCD_PutCode( uint8_t ch )
+{
+  if( hd_status & LCD_STATUS_TIMEOUT ) return ch;
+
+  if( hd_wrap_pending )
+  {
+    hd_wrap_pending = 0;
+
+    if( ch == '\r' )
+    {
+      hd_xpos = 0;
+    }
+    else if( ch == '\n' )
+    {
+      hd_ypos++;
+#ifdef HD_NL_DOES_CR
+      hd_xpos = 0;
+#endif
+
+      if( hd_ypos > YMAX )
+#ifdef LCD_SCROLL_SUPPORT
+      {
+        LCD_ScrollUp();
+        hd_ypos = YMAX;
+      }
+#else // The alternative is to wrap around and overwrite. Meh!
+      {
+        hd_xpos=0;
+        hd_ypos=0;
+      }
+#endif
+
+      LCD_SyncCursor();
+      return ch;
+    }
+    else
+    {
+      hd_xpos = 0;
+      hd_ypos++;
+
+      if( hd_ypos > YMAX )
+#ifdef LCD_SCROLL_SUPPORT
+      {
+        hd_ypos = YMAX;
+        LCD_ScrollUp();
+      }
+#else   // The alternative is to wrap around and overwrite. Meh!
+      {
+        hd_ypos = 0;
+      }
+#endif
+    }
+  }
+     
+  dd_addr = LCD_DDRAM_Addr( hd_xpos, hd_ypos );
+  
+  switch( ch )
+  {
+    case '\n':
+      hd_ypos++;
+#ifdef HD_NL_DOES_CR
+      hd_xpos = 0;
+#endif
+      if( hd_ypos > YMAX )
+#ifdef LCD_SCROLL_SUPPORT
+      {
+        LCD_ScrollUp();
+        hd_ypos = YMAX;
+      }
+#else // The alternative is to wrap around and overwrite. Meh!
+      {
+        hd_xpos=0;
+        hd_ypos=0;
+      }
+#endif
+      LCD_SyncCursor();
+      break;
+
+    case '\r':
+      {
+        hd_xpos = 0;
+        hd_wrap_pending = 0;
+        LCD_SyncCursor();
+        break;
+      }
+
+    default:
+      LCD_WriteCell( dd_addr, ch );
+      if( hd_xpos < XMAX )
+      {
+        hd_xpos++;
+      }
+      else
+      {
+        hd_wrap_pending = 1;
+      }
+
+    LCD_SyncCursor();
+  }
+  return ch;
+}
+
+/** Write a null-terminated string to the LCD.
+  *
+  * @param string: string to write
+  * @retval none
+  */
+void LCD_Puts( const char * string )
+{
+  if( string == NULL ) return;
+
+  while( *string )
+  {
+    LCD_Putchar( ( uint8_t )*string );
+    string++;
+  }
+}
+
+#ifdef LCD_VIEWPORT_SUPPORT
+
+/** Set up a viewport and home its cursor.
+  *
+  * The rectangle is clipped to the panel.
+  *
+  * @param vp: viewport to set up
+  * @param x, y: top left corner on the panel
+  * @param width, height: size in characters
+  * @param flags: LCD_VP_SCROLL and/or LCD_VP_NL_DOES_CR
+  * @retval none
+  */
+void LCD_VP_Init( LCD_Viewport * vp, uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t flags )
+{
+  if( vp == NULL ) return;
+
+  if( x > XMAX ) x = XMAX;
+  if( y > YMAX ) y = YMAX;
+  if( width  == 0 || width  > XMAX + 1 - x ) width  = XMAX + 1 - x;
+  if( height == 0 || height > YMAX + 1 - y ) height = YMAX + 1 - y;
+
+  vp->x            = x;
+  vp->y            = y;
+  vp->width        = width;
+  vp->height       = height;
+  vp->flags        = flags;
+  vp->xpos         = 0;
+  vp->ypos         = 0;
+  vp->wrap_pending = 0;
+}
+
+
+/** Move a viewport's cursor.
+  *
+  * @param vp: viewport
+  * @param x, y: position relative to the viewport, clamped to it
+  * @retval none
+  */
+void LCD_VP_Locate( LCD_Viewport * vp, uint8_t x, uint8_t y )
+{
+  if( vp == NULL ) return;
+
+  vp->xpos         = ( x < vp->width )  ? x : vp->width - 1;
+  vp->ypos         = ( y < vp->height ) ? y : vp->height - 1;
+  vp->wrap_pending = 0;
+}
+
+
+/** Move the contents of a viewport up one line, leaving the address
+  * counter wherever the last write put it.
+  *
+  * @param vp: viewport
+  * @retval none
+  */
+static void LCD_VP_ScrollUp( LCD_Viewport * vp )
+{
+  uint8_t line,
+          line_pos,
+          ch_moving;
+
+  vp->wrap_pending = 0;
+
+  for( line = 1; line < vp->height; line++ )
+    for( line_pos = 0; line_pos < vp->width; line_pos++ )
+    {
+      if( !LCD_ReadCell( vp->x + line_pos, vp->y + line, &ch_moving ) ) return;
+      LCD_WriteCell( LCD_DDRAM_Addr( vp->x + line_pos, vp->y + line - 1 ), ch_moving );
+    }
+
+  for( line_pos = 0; line_pos < vp->width; line_pos++ )
+  {
+    LCD_WriteCell( LCD_DDRAM_Addr( vp->x + line_pos, vp->y + vp->height - 1 ), 0x20 );
+  }
+}
+
+
+/** Scroll the contents of a viewport up one line.
+  *
+  * Only cells inside the viewport are read or written.
+  *
+  * @param vp: viewport
+  * @retval none
+  */
+void LCD_VP_Scroll( LCD_Viewport * vp )
+{
+  if( vp == NULL ) return;
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  LCD_VP_ScrollUp( vp );
+  LCD_SyncCursor();
+}
+
+
+/** Fill a viewport with spaces and home its cursor.
+  *
+  * @param vp: viewport
+  * @retval none
+  */
+void LCD_VP_Clear( LCD_Viewport * vp )
+{
+  uint8_t line,
+          line_pos;
+
+  if( vp == NULL ) return;
+
+  for( line = 0; line < vp->height; line++ )
+    for( line_pos = 0; line_pos < vp->width; line_pos++ )
+    {
+      LCD_WriteCell( LCD_DDRAM_Addr( vp->x + line_pos, vp->y + line ), 0x20 );
+    }
+
+  LCD_VP_Locate( vp, 0, 0 );
+  LCD_SyncCursor();
+}
+
+
+/** Move a viewport's cursor down a line, scrolling or wrapping to the
+  * top at the bottom edge as the viewport flags say.
+  *
+  * @param vp: viewport
+  * @retval none
+  */
+static void LCD_VP_NextLine( LCD_Viewport * vp )
+{
+  if( vp->ypos + 1 < vp->height )
+  {
+    vp->ypos++;
+  }
+  else if( vp->flags & LCD_VP_SCROLL )
+  {
+    LCD_VP_ScrollUp( vp );
+  }
+  else
+  {
+    vp->xpos = 0;
+    vp->ypos = 0;
+  }
+}
+
+
+/** Write one character to a viewport without restoring the address
+  * counter.
+  *
+  * @param vp: viewport
+  * @param ch: character to write
+  * @retval none
+  */
+static void LCD_VP_Write( LCD_Viewport * vp, uint8_t ch )
+{
+#ifdef LCD_UTF8_SUPPORT
+  uint8_t codes[ 2 ],
+          count,
+          index;
+
+  count = LCD_UTF8_Translate( ch, codes );
+  for( index = 0; index < count; index++ ) LCD_VP_PutCode( vp, codes[ index ] );
+#else
+  LCD_VP_PutCode( vp, ch );
+#endif
+}
+
+
+/** Write one character to a viewport.
+  *
+  * Follows the same rules as LCD_Putchar(), but inside the viewport: wrap
+  * is deferred after the last column, '\r' returns to column 0 and '\n'
+  * moves down a line, also returning when LCD_VP_NL_DOES_CR is set.  The
+  * address counter goes back to the main cursor afterwards.
+  *
+  * @param vp: viewport
+  * @param ch: character to write
+  * @retval uint8_t: the character written
+  */
+uint8_t LCD_VP_Putchar( LCD_Viewport * vp, uint8_t ch )
+{
+  if( vp == NULL ) return ch;
+
+  LCD_VP_Write( vp, ch );
+  LCD_SyncCursor();
+
+  return ch;
+}
+
+
+/** Write one character code to a viewport.
+  *
+  * @param vp: viewport
+  * @param ch: character code, already translated for the ROM
+  * @retval uint8_t: the character written
+  */
+static uint8_t LCD_VP_PutCode( LCD_Viewport * vp, uint8_t ch )
+{
+  if( vp == NULL ) return ch;
+  if( hd_status & LCD_STATUS_TIMEOUT ) return ch;
+
+  if( vp->wrap_pending )
+  {
+    vp->wrap_pending = 0;
+
+    if( ch != '\r' && ch != '\n' )
+    {
+      vp->xpos = 0;
+      LCD_VP_NextLine( vp );
+    }
+  }
+
+  switch( ch )
+  {
+    case '\n':
+      if( vp->flags & LCD_VP_NL_DOES_CR ) vp->xpos = 0;
+      LCD_VP_NextLine( vp );
+      break;
+
+    case '\r':
+      vp->xpos = 0;
+      break;
+
+    default:
+      LCD_WriteCell( LCD_DDRAM_Addr( vp->x + vp->xpos, vp->y + vp->ypos ), ch );
+      if( vp->xpos + 1 < vp->width )
+      {
+        vp->xpos++;
+      }
+      else
+      {
+        vp->wrap_pending = 1;
+      }
+  }
+
+  return ch;
+}
+
+
+/** Write a null-terminated string to a viewport.
+  *
+  * @param vp: viewport
+  * @param string: string to write
+  * @retval none
+  */
+void LCD_VP_Puts( LCD_Viewport * vp, const char * string )
+{
+  if( vp == NULL || string == NULL ) return;
+
+  while( *string )
+  {
+    LCD_VP_Write( vp, ( uint8_t )*string );
+    string++;
+  }
+
+  LCD_SyncCursor();
+}
+
+#endif
+
+#if defined( LCD_MARQUEE_SUPPORT ) || defined( LCD_PAGE_SUPPORT )
+
+/** Follow the display shift.
+  *
+  * @param cmd: instruction just sent
+  * @retval none
+  */
+static void LCD_TrackShift( uint8_t cmd )
+{
+  if( cmd >= FUNC_SET ) return;
+
+  if( cmd & CURS_DISP_SH )
+  {
+    if( !( cmd & DIS_SHIFT ) ) return;
+
+    hd_shift = ( cmd & RIGHT ) ? ( hd_shift + LCD_SHIFT_SPAN - 1 ) % LCD_SHIFT_SPAN
+                               : ( hd_shift + 1 ) % LCD_SHIFT_SPAN;
+  }
+  else if( cmd && cmd < ENT_MODE )
+  {
+    hd_shift = 0;
+#ifdef LCD_PAGE_SUPPORT
+    hd_page_draw = 0;
+#endif
+  }
+}
+
+#endif
+
+
+#if defined( LCD_MARQUEE_SUPPORT ) || defined( LCD_ANIM_SUPPORT )
+
+/** Check whether a periodic step is due and advance its time.
+  *
+  * Keeps to the rate, but does not try to catch up after a long stall.
+  *
+  * @param last: time of the last step, updated when one is due
+  * @param interval_us: time between steps
+  * @param now: current LCD_Time_us()
+  * @retval uint8_t: 1 if a step is due, else 0
+  */
+static uint8_t LCD_TickDue( uint32_t * last, uint32_t interval_us, uint32_t now )
+{
+  if( now - *last < interval_us ) return 0;
+
+  *last += interval_us;
+  if( now - *last >= interval_us ) *last = now;
+
+  return 1;
+}
+
+#endif
+
+
+#ifdef LCD_MARQUEE_SUPPORT
+
+
+/** Write one marquee character, wrapping round within the DDRAM line.
+  *
+  * @param ch: character code
+  * @param base: address of the start of the line
+  * @param col: column within the line, advanced
+  * @retval none
+  */
+static void LCD_MarqueeWrite( uint8_t ch, uint8_t base, uint8_t * col )
+{
+  LCD_PutData( ch );
+
+  if( ++*col == LCD_SHIFT_SPAN )
+  {
+    *col = 0;
+    LCD_Command( SET_DDRAM_ADD | base );
+  }
+}
+
+
+/** Load text into a whole DDRAM line and start scrolling it.
+  *
+  * The line is filled once, starting at row y, and wraps round through
+  * its off-screen part.  After that each step is a single display shift
+  * instruction.  The shift moves every row, so on 4-row panels row y
+  * and the row two below it scroll as one line.
+  *
+  * @param y: row to start the text on
+  * @param string: text, padded with spaces to the length of the line
+  * @param interval_ms: time between steps
+  * @retval none
+  */
+void LCD_MarqueeStart( uint8_t y, const char * string, uint16_t interval_ms )
+{
+  uint8_t start = LCD_DDRAM_Addr( 0, y ),
+          base  = ( NUMLINES == TWOLINES ) ? ( start & 0x40 ) : 0,
+          col   = start - base,
+          count = 0,
+          ch;
+#ifdef LCD_UTF8_SUPPORT
+  uint8_t codes[ 2 ],
+          index,
+          decoded;
+#endif
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  if( hd_shift ) LCD_Command( RET_HOME );
+  LCD_Command( SET_DDRAM_ADD | start );
+
+  while( count < LCD_SHIFT_SPAN )
+  {
+    ch = ( string != NULL && *string ) ? ( uint8_t )*string++ : ' ';
+
+#ifdef LCD_UTF8_SUPPORT
+    decoded = LCD_UTF8_Translate( ch, codes );
+    for( index = 0; index < decoded && count < LCD_SHIFT_SPAN; index++, count++ )
+    {
+      LCD_MarqueeWrite( codes[ index ], base, &col );
+    }
+#else
+    LCD_MarqueeWrite( ch, base, &col );
+    count++;
+#endif
+  }
+
+  hd_marquee_on   = 1;
+  hd_marquee_us   = interval_ms * 1000UL;
+  hd_marquee_last = LCD_Time_us();
+
+  LCD_SyncCursor();
+}
+
+
+/** Step the marquee if its interval has passed.
+  *
+  * @retval uint8_t: 1 if a step was sent, else 0
+  */
+uint8_t LCD_MarqueeTick( void )
+{
+  if( !hd_marquee_on || ( hd_status & LCD_STATUS_TIMEOUT ) ) return 0;
+
+  if( !LCD_TickDue( &hd_marquee_last, hd_marquee_us, LCD_Time_us() ) ) return 0;
+
+  LCD_Command( CURS_DISP_SH | DIS_SHIFT );
+  return 1;
+}
+
+
+/** Stop the marquee and put the display back unshifted.
+  *
+  * The marquee text stays in DDRAM.
+  *
+  * @retval none
+  */
+void LCD_MarqueeStop( void )
+{
+  hd_marquee_on = 0;
+
+  if( hd_shift )
+  {
+    LCD_Command( RET_HOME );
+    LCD_SyncCursor();
+  }
+}
+
+#endif
+
+
+#ifdef LCD_CANVAS_SUPPORT
+
+/** Clear every pixel of the canvas.
+  *
+  * @retval none
+  */
+void LCD_CanvasClear( void )
+{
+  uint8_t cell,
+          row;
+
+  for( cell = 0; cell < LCD_CANVAS_CELLS; cell++ )
+  {
+    for( row = 0; row < LCD_CGRAM_CHAR_ROWS; row++ ) hd_canvas[ cell ][ row ] = 0;
+  }
+}
+
+
+/** Set, clear or toggle one canvas pixel.
+  *
+  * @param x: pixel column, 0 at the left
+  * @param y: pixel row, 0 at the top
+  * @param mode: LCD_PIXEL_SET, LCD_PIXEL_CLEAR or LCD_PIXEL_TOGGLE
+  * @retval none
+  */
+void LCD_CanvasPixel( uint8_t x, uint8_t y, uint8_t mode )
+{
+  uint8_t * row;
+  uint8_t   bit;
+
+  if( x >= LCD_CANVAS_WIDTH || y >= LCD_CANVAS_HEIGHT ) return;
+
+  row = &hd_canvas[ ( y / LCD_CGRAM_CHAR_ROWS ) * LCD_CANVAS_COLS + x / 5 ][ y % LCD_CGRAM_CHAR_ROWS ];
+  bit = 0x10 >> ( x % 5 );
+
+  if( mode == LCD_PIXEL_TOGGLE )     *row ^= bit;
+  else if( mode == LCD_PIXEL_CLEAR ) *row &= ~bit;
+  else                               *row |= bit;
+}
+
+
+/** Read one canvas pixel.
+  *
+  * @param x: pixel column
+  * @param y: pixel row
+  * @retval uint8_t: 1 if the pixel is set, 0 if clear or off the canvas
+  */
+uint8_t LCD_CanvasGetPixel( uint8_t x, uint8_t y )
+{
+  if( x >= LCD_CANVAS_WIDTH || y >= LCD_CANVAS_HEIGHT ) return 0;
+
+  return ( hd_canvas[ ( y / LCD_CGRAM_CHAR_ROWS ) * LCD_CANVAS_COLS + x / 5 ][ y % LCD_CGRAM_CHAR_ROWS ]
+           >> ( 4 - x % 5 ) ) & 1u;
+}
+
+
+/** Draw a straight line between two pixels, both included.
+  *
+  * Each pixel is drawn once, so LCD_PIXEL_TOGGLE gives a clean line.
+  *
+  * @param x0, y0: start pixel
+  * @param x1, y1: end pixel
+  * @param mode: LCD_PIXEL_SET, LCD_PIXEL_CLEAR or LCD_PIXEL_TOGGLE
+  * @retval none
+  */
+void LCD_CanvasLine( uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t mode )
+{
+  int16_t dx  = ( x1 > x0 ) ? x1 - x0 : x0 - x1,
+          dy  = ( y1 > y0 ) ? y0 - y1 : y1 - y0,
+          sx  = ( x1 > x0 ) ? 1 : -1,
+          sy  = ( y1 > y0 ) ? 1 : -1,
+          err = dx + dy,
+          e2;
+
+  for( ;; )
+  {
+    LCD_CanvasPixel( x0, y0, mode );
+    if( x0 == x1 && y0 == y1 ) break;
+
+    e2 = 2 * err;
+    if( e2 >= dy ) { err += dy; x0 += sx; }
+    if( e2 <= dx ) { err += dx; y0 += sy; }
+  }
+}
+
+
+/** Fill a rectangle of pixels.
+  *
+  * @param x, y: top-left pixel
+  * @param w, h: width and height in pixels, clipped to the canvas
+  * @param mode: LCD_PIXEL_SET, LCD_PIXEL_CLEAR or LCD_PIXEL_TOGGLE
+  * @retval none
+  */
+void LCD_CanvasFill( uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t mode )
+{
+  uint8_t col,
+          line;
+
+  for( line = y; line < LCD_CANVAS_HEIGHT && line - y < h; line++ )
+  {
+    for( col = x; col < LCD_CANVAS_WIDTH && col - x < w; col++ ) LCD_CanvasPixel( col, line, mode );
+  }
+}
+
+
+/** Put the canvas cells on screen.
+  *
+  * Only needed once, as later drawing changes CGRAM and not DDRAM.
+  *
+  * @param x: character column of the canvas's top-left cell
+  * @param y: character row of the canvas's top-left cell
+  * @retval none
+  */
+void LCD_CanvasPlace( uint8_t x, uint8_t y )
+{
+  uint8_t col,
+          row;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  for( row = 0; row < LCD_CANVAS_ROWS && y + row <= YMAX; row++ )
+  {
+    for( col = 0; col < LCD_CANVAS_COLS && x + col <= XMAX; col++ )
+    {
+      LCD_WriteCell( LCD_DDRAM_Addr( x + col, y + row ), LCD_CANVAS_FIRST + row * LCD_CANVAS_COLS + col );
+    }
+  }
+
+  LCD_SyncCursor();
+}
+
+
+/** Send the CGRAM rows that differ from the canvas.
+  *
+  * Each run of changed rows costs one address instruction and a data
+  * write per row.  LCD_Flush() calls this first when the frame buffer
+  * is in use.
+  *
+  * @retval uint8_t: number of CGRAM rows written
+  */
+uint8_t LCD_CanvasUpload( void )
+{
+  uint8_t cell,
+          row,
+          addr,
+          next = 0xFF,
+          sent = 0;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return 0;
+
+  for( cell = 0; cell < LCD_CANVAS_CELLS; cell++ )
+  {
+    for( row = 0; row < LCD_CGRAM_CHAR_ROWS; row++ )
+    {
+      if( ( hd_canvas_known & ( 1u << cell ) ) &&
+          hd_canvas_glass[ cell ][ row ] == hd_canvas[ cell ][ row ] ) continue;
+
+      addr = ( LCD_CANVAS_FIRST + cell ) * LCD_CGRAM_CHAR_STRIDE + row;
+      if( addr != next ) LCD_Command( SET_CGRAM_ADD | addr );
+      LCD_PutData( hd_canvas[ cell ][ row ] );
+
+      hd_canvas_glass[ cell ][ row ] = hd_canvas[ cell ][ row ];
+#ifdef LCD_RECOVER_SUPPORT
+      hd_cgram_shadow[ LCD_CANVAS_FIRST + cell ][ row ] = hd_canvas[ cell ][ row ];
+#endif
+      next = addr + 1;
+      sent++;
+    }
+
+    hd_canvas_known |= 1u << cell;
+#ifdef LCD_RECOVER_SUPPORT
+    hd_cgram_valid  |= 1u << ( LCD_CANVAS_FIRST + cell );
+#endif
+  }
+
+#ifdef LCD_WIDGET_SUPPORT
+  if( sent ) hd_widget_set = LCD_WIDGET_SET_NONE;
+#endif
+  if( sent ) LCD_SyncCursor();
+
+  return sent;
+}
+
+#endif
+
+
+#ifdef LCD_GLYPH_PACK_SUPPORT
+
+#ifndef LCD_UDG_SUPPORT
+  #error LCD_GLYPH_PACK_SUPPORT needs LCD_UDG_SUPPORT.
+#endif
+
+/** Load a glyph pack into consecutive CGRAM slots.
+  *
+  * One address instruction, then every row decoded straight from the
+  * pack, with the unused rows of 5x10 slots zeroed so the burst runs on.
+  * The DDRAM address is restored from the driver cursor rather than
+  * read back.
+  *
+  * @param pack: pack built with LCD_GLYPH_PACK()
+  * @param first_slot: CGRAM slot for the first glyph
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if the pack does
+  *                  not suit the font or the slots
+  */
+uint8_t LCD_LoadGlyphPack( const uint8_t * pack, uint8_t first_slot )
+{
+  const uint8_t * bits;
+  uint16_t        acc;
+  uint8_t         count,
+                  glyph,
+                  have,
+                  row,
+                  value;
+
+  if( pack == NULL || pack[ 0 ] != LCD_CGRAM_CHAR_ROWS ) return LCD_RESULT_ERROR;
+
+  count = pack[ 1 ];
+  bits  = &pack[ 2 ];
+
+  if( first_slot >= LCD_CGRAM_CHAR_SLOTS || count > LCD_CGRAM_CHAR_SLOTS - first_slot ) return LCD_RESULT_ERROR;
+  if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_RESULT_ERROR;
+  if( count == 0 ) return LCD_RESULT_OK;
+
+  LCD_Command( SET_CGRAM_ADD | ( first_slot * LCD_CGRAM_CHAR_STRIDE ) );
+
+  for( glyph = 0; glyph < count; glyph++ )
+  {
+    acc  = 0;
+    have = 0;
+
+    for( row = 0; row < LCD_CGRAM_CHAR_STRIDE; row++ )
+    {
+      value = 0;
+
+      if( row < LCD_CGRAM_CHAR_ROWS )
+      {
+        if( have < 5 )
+        {
+          acc   = ( acc << 8 ) | *bits++;
+          have += 8;
+        }
+        have -= 5;
+        value = ( acc >> have ) & 0x1F;
+
+#ifdef LCD_RECOVER_SUPPORT
+        hd_cgram_shadow[ first_slot + glyph ][ row ] = value;
+#endif
+      }
+
+      LCD_PutData( value );
+    }
+
+#ifdef LCD_RECOVER_SUPPORT
+    hd_cgram_valid |= 1u << ( first_slot + glyph );
+#endif
+    LCD_CANVAS_FORGET( first_slot + glyph );
+  }
+
+#ifdef LCD_WIDGET_SUPPORT
+  hd_widget_set = LCD_WIDGET_SET_NONE;
+#endif
+
+  LCD_SyncCursor();
+
+  return ( hd_status & LCD_STATUS_TIMEOUT ) ? LCD_RESULT_ERROR : LCD_RESULT_OK;
+}
+
+#endif
+
+
+#ifdef LCD_ANIM_SUPPORT
+
+/** Stop every animation.
+  *
+  * @retval none
+  */
+static void LCD_AnimReset( void )
+{
+  uint8_t anim;
+
+  for( anim = 0; anim < LCD_ANIM_MAX; anim++ ) hd_anim[ anim ].slot = LCD_ANIM_FREE;
+}
+
+
+/** Send the rows flagged in each due animation's delta.
+  *
+  * Rows go out in CGRAM address order with one address instruction per
+  * run, so neighbouring slots share a burst.  The driver cursor is
+  * restored afterwards.
+  *
+  * @retval uint8_t: number of rows written
+  */
+static uint8_t LCD_AnimSend( void )
+{
+  LCD_Anim * anim;
+  uint8_t    slot,
+             index,
+             row,
+             addr,
+             value,
+             next = 0xFF,
+             sent = 0;
+
+  for( slot = 0; slot < LCD_CGRAM_CHAR_SLOTS; slot++ )
+  {
+    for( index = 0; index < LCD_ANIM_MAX; index++ )
+    {
+      anim = &hd_anim[ index ];
+      if( anim->slot != slot || !anim->due ) continue;
+
+      for( row = 0; row < LCD_CGRAM_CHAR_ROWS; row++ )
+      {
+        if( !( anim->delta[ anim->frame ] & ( 1u << row ) ) ) continue;
+
+        addr  = slot * LCD_CGRAM_CHAR_STRIDE + row;
+        value = anim->frames[ anim->frame * LCD_CGRAM_CHAR_ROWS + row ];
+
+        if( addr != next ) LCD_Command( SET_CGRAM_ADD | addr );
+        LCD_PutData( value );
+#ifdef LCD_RECOVER_SUPPORT
+        hd_cgram_shadow[ slot ][ row ] = value;
+#endif
+        next = addr + 1;
+        sent++;
+      }
+
+      LCD_CANVAS_FORGET( slot );
+      anim->due = 0;
+    }
+  }
+
+#ifdef LCD_WIDGET_SUPPORT
+  if( sent ) hd_widget_set = LCD_WIDGET_SET_NONE;
+#endif
+  if( sent ) LCD_SyncCursor();
+
+  return sent;
+}
+
+
+/** Start animating a custom character.
+  *
+  * The row differences between frames are worked out here, so each tick
+  * only has to send them.  Frame 0 is loaded straight away.  Starting a
+  * slot that is already animating replaces its animation.
+  *
+  * @param slot: CGRAM slot, as for LCD_Defchar()
+  * @param frames: count patterns of LCD_CGRAM_CHAR_ROWS bytes each
+  * @param count: number of frames, 1 to LCD_ANIM_FRAMES
+  * @param interval_ms: time per frame
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if no animation
+  *                  is free or an argument is out of range
+  */
+uint8_t LCD_AnimStart( uint8_t slot, const uint8_t * frames, uint8_t count, uint16_t interval_ms )
+{
+  LCD_Anim * anim = NULL;
+  uint8_t    index,
+             frame,
+             prev,
+             row;
+
+  if( frames == NULL || slot >= LCD_CGRAM_CHAR_SLOTS ) return LCD_RESULT_ERROR;
+  if( count == 0 || count > LCD_ANIM_FRAMES ) return LCD_RESULT_ERROR;
+
+  for( index = 0; index < LCD_ANIM_MAX; index++ )
+  {
+    if( hd_anim[ index ].slot == slot ) { anim = &hd_anim[ index ]; break; }
+    if( anim == NULL && hd_anim[ index ].slot == LCD_ANIM_FREE ) anim = &hd_anim[ index ];
+  }
+  if( anim == NULL ) return LCD_RESULT_ERROR;
+
+  for( frame = 0; frame < count; frame++ )
+  {
+    prev = frame ? frame - 1 : count - 1;
+    anim->delta[ frame ] = 0;
+
+    for( row = 0; row < LCD_CGRAM_CHAR_ROWS; row++ )
+    {
+      if( frames[ frame * LCD_CGRAM_CHAR_ROWS + row ] != frames[ prev * LCD_CGRAM_CHAR_ROWS + row ] )
+      {
+        anim->delta[ frame ] |= 1u << row;
+      }
+    }
+  }
+
+  anim->frames      = frames;
+  anim->count       = count;
+  anim->interval_us = interval_ms * 1000UL;
+  anim->slot        = slot;
+
+  /* Frame 0 goes out whole, as the slot may hold anything. */
+  LCD_Defchar( slot, frames );
+
+  anim->frame = 0;
+  anim->due   = 0;
+  anim->last  = LCD_Time_us();
+
+  return LCD_RESULT_OK;
+}
+
+
+/** Stop animating a custom character.  It keeps its current frame.
+  *
+  * @param slot: CGRAM slot given to LCD_AnimStart()
+  * @retval none
+  */
+void LCD_AnimStop( uint8_t slot )
+{
+  uint8_t index;
+
+  for( index = 0; index < LCD_ANIM_MAX; index++ )
+  {
+    if( hd_anim[ index ].slot == slot ) hd_anim[ index ].slot = LCD_ANIM_FREE;
+  }
+}
+
+
+/** Advance the animations that are due and send what changed.
+  *
+  * Call from the main loop or a periodic tick.
+  *
+  * @retval uint8_t: number of CGRAM rows written
+  */
+uint8_t LCD_AnimTick( void )
+{
+  LCD_Anim * anim;
+  uint32_t   now;
+  uint8_t    index,
+             any = 0;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return 0;
+
+  now = LCD_Time_us();
+
+  for( index = 0; index < LCD_ANIM_MAX; index++ )
+  {
+    anim = &hd_anim[ index ];
+    if( anim->slot == LCD_ANIM_FREE || anim->count < 2 ) continue;
+    if( !LCD_TickDue( &anim->last, anim->interval_us, now ) ) continue;
+
+    anim->frame = ( anim->frame + 1 ) % anim->count;
+    anim->due   = 1;
+    any         = 1;
+  }
+
+  return any ? LCD_AnimSend() : 0;
+}
+
+#endif
+
+
+#ifdef LCD_WIDGET_SUPPORT
+
+/** Big digit pieces, after the classic 8-character big font. */
+#define LCD_BIG_LT                  0u    // Left top corner
+#define LCD_BIG_UB                  1u    // Upper bar
+#define LCD_BIG_RT                  2u    // Right top corner
+#define LCD_BIG_LL                  3u    // Left lower corner
+#define LCD_BIG_LB                  4u    // Lower bar
+#define LCD_BIG_LR                  5u    // Right lower corner
+#define LCD_BIG_UMB                 6u    // Upper and middle bars
+#define LCD_BIG_FB                  LCD_WIDGET_BLOCK
+#define LCD_BIG_SP                  ' '
+
+static const uint8_t hd_big_glyphs[ 7 ][ 8 ] =
+{
+  { 0x07, 0x0F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F },
+  { 0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00 },
+  { 0x1C, 0x1E, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F },
+  { 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x0F, 0x07 },
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F },
+  { 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1E, 0x1C },
+  { 0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x1F, 0x1F }
+};
+
+/** Cell codes of the digits 0 to 9 and a blank, row by row. */
+static const uint8_t hd_big2[ 11 ][ 2 ][ 3 ] =
+{
+  { { LCD_BIG_LT,  LCD_BIG_UB,  LCD_BIG_RT  }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_UB,  LCD_BIG_RT,  LCD_BIG_SP  }, { LCD_BIG_LB, LCD_BIG_FB, LCD_BIG_LB } },
+  { { LCD_BIG_UMB, LCD_BIG_UMB, LCD_BIG_RT  }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_LB } },
+  { { LCD_BIG_UMB, LCD_BIG_UMB, LCD_BIG_RT  }, { LCD_BIG_LB, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_LL,  LCD_BIG_LB,  LCD_BIG_FB  }, { LCD_BIG_SP, LCD_BIG_SP, LCD_BIG_FB } },
+  { { LCD_BIG_FB,  LCD_BIG_UMB, LCD_BIG_UMB }, { LCD_BIG_LB, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_LT,  LCD_BIG_UMB, LCD_BIG_UMB }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_UB,  LCD_BIG_UB,  LCD_BIG_RT  }, { LCD_BIG_SP, LCD_BIG_SP, LCD_BIG_FB } },
+  { { LCD_BIG_LT,  LCD_BIG_UMB, LCD_BIG_RT  }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_LT,  LCD_BIG_UMB, LCD_BIG_RT  }, { LCD_BIG_LB, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_SP,  LCD_BIG_SP,  LCD_BIG_SP  }, { LCD_BIG_SP, LCD_BIG_SP, LCD_BIG_SP } }
+};
+
+static const uint8_t hd_big3[ 11 ][ 3 ][ 3 ] =
+{
+  { { LCD_BIG_LT, LCD_BIG_UB, LCD_BIG_RT }, { LCD_BIG_FB, LCD_BIG_SP, LCD_BIG_FB }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_UB, LCD_BIG_RT, LCD_BIG_SP }, { LCD_BIG_SP, LCD_BIG_FB, LCD_BIG_SP }, { LCD_BIG_LB, LCD_BIG_FB, LCD_BIG_LB } },
+  { { LCD_BIG_UB, LCD_BIG_UB, LCD_BIG_RT }, { LCD_BIG_LB, LCD_BIG_LB, LCD_BIG_LR }, { LCD_BIG_FB, LCD_BIG_LB, LCD_BIG_LB } },
+  { { LCD_BIG_UB, LCD_BIG_UB, LCD_BIG_RT }, { LCD_BIG_SP, LCD_BIG_LB, LCD_BIG_FB }, { LCD_BIG_LB, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_FB, LCD_BIG_SP, LCD_BIG_FB }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_FB }, { LCD_BIG_SP, LCD_BIG_SP, LCD_BIG_FB } },
+  { { LCD_BIG_FB, LCD_BIG_UB, LCD_BIG_UB }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_RT }, { LCD_BIG_LB, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_LT, LCD_BIG_UB, LCD_BIG_UB }, { LCD_BIG_FB, LCD_BIG_LB, LCD_BIG_RT }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_UB, LCD_BIG_UB, LCD_BIG_RT }, { LCD_BIG_SP, LCD_BIG_SP, LCD_BIG_FB }, { LCD_BIG_SP, LCD_BIG_SP, LCD_BIG_FB } },
+  { { LCD_BIG_LT, LCD_BIG_UB, LCD_BIG_RT }, { LCD_BIG_FB, LCD_BIG_LB, LCD_BIG_FB }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_LT, LCD_BIG_UB, LCD_BIG_RT }, { LCD_BIG_LL, LCD_BIG_LB, LCD_BIG_FB }, { LCD_BIG_LB, LCD_BIG_LB, LCD_BIG_LR } },
+  { { LCD_BIG_SP, LCD_BIG_SP, LCD_BIG_SP }, { LCD_BIG_SP, LCD_BIG_SP, LCD_BIG_SP }, { LCD_BIG_SP, LCD_BIG_SP, LCD_BIG_SP } }
+};
+
+
+/** Load a widget character set into CGRAM unless it is already there.
+  *
+  * Bar sets hold the partly filled cells, slot n having n + 1 steps.
+  *
+  * @param set: LCD_WIDGET_SET_HBAR, _VBAR or _BIGNUM
+  * @retval none
+  */
+static void LCD_WidgetLoad( uint8_t set )
+{
+  uint8_t glyph[ 8 ],
+          slot,
+          row;
+
+  if( hd_widget_set == set ) return;
+
+  for( slot = 0; slot < 7; slot++ )
+  {
+    if( set == LCD_WIDGET_SET_HBAR && slot >= 4 ) break;
+
+    for( row = 0; row < 8; row++ )
+    {
+      if( set == LCD_WIDGET_SET_HBAR )      glyph[ row ] = ( 0x1F << ( 4 - slot ) ) & 0x1F;
+      else if( set == LCD_WIDGET_SET_VBAR ) glyph[ row ] = ( row >= 7 - slot ) ? 0x1F : 0x00;
+      else                                  glyph[ row ] = hd_big_glyphs[ slot ][ row ];
+    }
+
+    LCD_Defchar( slot, glyph );
+  }
+
+  if( !( hd_status & LCD_STATUS_TIMEOUT ) ) hd_widget_set = set;
+}
+
+
+/** Set up a bar graph.  Nothing is drawn until LCD_BarSet().
+  *
+  * @param bar: bar to set up
+  * @param x, y: first cell, the bottom one for a vertical bar
+  * @param length: size in cells
+  * @param direction: LCD_BAR_HORIZONTAL or LCD_BAR_VERTICAL
+  * @retval none
+  */
+void LCD_BarInit( LCD_Bar * bar, uint8_t x, uint8_t y, uint8_t length, uint8_t direction )
+{
+  if( bar == NULL ) return;
+
+  bar->x         = x;
+  bar->y         = y;
+  bar->length    = length;
+  bar->direction = direction;
+  bar->shown     = LCD_BAR_UNKNOWN;
+}
+
+
+/** Return the character for one cell of a bar.
+  *
+  * @param value: bar value in steps
+  * @param cell: cell number from the start of the bar
+  * @param steps: steps per cell
+  * @retval uint8_t: space, a CGRAM slot or LCD_WIDGET_BLOCK
+  */
+static uint8_t LCD_BarCell( uint16_t value, uint8_t cell, uint8_t steps )
+{
+  uint16_t start = ( uint16_t )cell * steps;
+
+  if( value <= start ) return ' ';
+  if( value - start >= steps ) return LCD_WIDGET_BLOCK;
+
+  return value - start - 1;
+}
+
+
+/** Draw a bar graph, rewriting only the cells that change.
+  *
+  * A one step change is one data write.
+  *
+  * @param bar: bar set up with LCD_BarInit()
+  * @param value: length in steps, clamped to the bar
+  * @retval none
+  */
+void LCD_BarSet( LCD_Bar * bar, uint16_t value )
+{
+  uint8_t steps,
+          cell,
+          code,
+          x,
+          y,
+          sent = 0;
+
+  if( bar == NULL || hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  steps = ( bar->direction == LCD_BAR_VERTICAL ) ? 8 : 5;
+  if( value > ( uint16_t )bar->length * steps ) value = bar->length * steps;
+  if( value == bar->shown ) return;
+
+  LCD_WidgetLoad( ( bar->direction == LCD_BAR_VERTICAL ) ? LCD_WIDGET_SET_VBAR : LCD_WIDGET_SET_HBAR );
+
+  for( cell = 0; cell < bar->length; cell++ )
+  {
+    code = LCD_BarCell( value, cell, steps );
+    if( bar->shown != LCD_BAR_UNKNOWN && code == LCD_BarCell( bar->shown, cell, steps ) ) continue;
+
+    x = bar->x;
+    y = bar->y;
+    if( bar->direction == LCD_BAR_VERTICAL ) y -= cell; else x += cell;
+    if( x > XMAX || y > YMAX ) break;
+
+    LCD_WriteCell( LCD_DDRAM_Addr( x, y ), code );
+    sent = 1;
+  }
+
+  bar->shown = value;
+  if( sent ) LCD_SyncCursor();
+}
+
+
+/** Set up a big number.  Nothing is drawn until LCD_BigNumSet().
+  *
+  * @param num: number to set up
+  * @param x, y: top left corner
+  * @param digits: digit positions, up to LCD_BIGNUM_DIGITS
+  * @param rows: 2 or 3
+  * @retval none
+  */
+void LCD_BigNumInit( LCD_BigNum * num, uint8_t x, uint8_t y, uint8_t digits, uint8_t rows )
+{
+  uint8_t pos;
+
+  if( num == NULL ) return;
+
+  num->x      = x;
+  num->y      = y;
+  num->digits = ( digits > LCD_BIGNUM_DIGITS ) ? LCD_BIGNUM_DIGITS : digits;
+  num->rows   = ( rows == 3 ) ? 3 : 2;
+
+  for( pos = 0; pos < LCD_BIGNUM_DIGITS; pos++ ) num->shown[ pos ] = LCD_BIG_UNKNOWN;
+}
+
+
+/** Return one cell of a big digit.
+  *
+  * @param rows: 2 or 3
+  * @param digit: 0 to 9 or LCD_BIG_BLANK
+  * @param row, col: cell within the digit
+  * @retval uint8_t: character code
+  */
+static uint8_t LCD_BigCell( uint8_t rows, uint8_t digit, uint8_t row, uint8_t col )
+{
+  return ( rows == 3 ) ? hd_big3[ digit ][ row ][ col ] : hd_big2[ digit ][ row ][ col ];
+}
+
+
+/** Draw a big number, rewriting only the cells that change.
+  *
+  * @param num: number set up with LCD_BigNumInit()
+  * @param value: value to show
+  * @retval none
+  */
+void LCD_BigNumSet( LCD_BigNum * num, uint32_t value )
+{
+  uint8_t pos,
+          digit,
+          old,
+          row,
+          col,
+          code,
+          x,
+          sent = 0;
+
+  if( num == NULL || hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  LCD_WidgetLoad( LCD_WIDGET_SET_BIGNUM );
+
+  for( pos = num->digits; pos-- > 0; )
+  {
+    digit  = ( value || pos == num->digits - 1 ) ? value % 10 : LCD_BIG_BLANK;
+    value /= 10;
+    old    = num->shown[ pos ];
+    if( digit == old ) continue;
+
+    for( row = 0; row < num->rows && num->y + row <= YMAX; row++ )
+    {
+      for( col = 0; col < 3; col++ )
+      {
+        x    = num->x + pos * 4 + col;
+        code = LCD_BigCell( num->rows, digit, row, col );
+        if( x > XMAX ) break;
+        if( old != LCD_BIG_UNKNOWN && code == LCD_BigCell( num->rows, old, row, col ) ) continue;
+
+        LCD_WriteCell( LCD_DDRAM_Addr( x, num->y + row ), code );
+        sent = 1;
+      }
+    }
+
+    num->shown[ pos ] = digit;
+  }
+
+  if( sent ) LCD_SyncCursor();
+}
+
+#endif
+
+
+#ifdef LCD_WAVE_SUPPORT
+
+/** Build the BSRR word that puts a value on the bus with E low.
+  *
+  * @param rs: INSTR_REG or DATA_REG
+  * @param bits: value for D7..D4, or D7..D0 on an 8-bit bus
+  * @retval uint32_t: BSRR word
+  */
+static uint32_t LCD_WaveBus( uint8_t rs, uint8_t bits )
+{
+  uint32_t set   = 0,
+           reset = LCD_RNW | LCD_E;
+
+  if( rs )          set |= LCD_RS; else reset |= LCD_RS;
+  if( bits & 0x80 ) set |= LCD_D7; else reset |= LCD_D7;
+  if( bits & 0x40 ) set |= LCD_D6; else reset |= LCD_D6;
+  if( bits & 0x20 ) set |= LCD_D5; else reset |= LCD_D5;
+  if( bits & 0x10 ) set |= LCD_D4; else reset |= LCD_D4;
+
+#ifdef LCD_BUS8BIT
+  if( bits & 0x08 ) set |= LCD_D3; else reset |= LCD_D3;
+  if( bits & 0x04 ) set |= LCD_D2; else reset |= LCD_D2;
+  if( bits & 0x02 ) set |= LCD_D1; else reset |= LCD_D1;
+  if( bits & 0x01 ) set |= LCD_D0; else reset |= LCD_D0;
+#endif
+
+  return set | ( reset << 16 );
+}
+
+
+/** Note the tracked state before the first append.
+  *
+  * @retval none
+  */
+static void LCD_WaveSave( void )
+{
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  uint8_t cell;
+
+  for( cell = 0; cell < sizeof( hd_wave_cells ); cell++ ) hd_wave_cells[ cell ] = 0;
+  hd_wave_fb_entry   = hd_fb_entry;
+#endif
+#ifdef LCD_RECOVER_SUPPORT
+  hd_wave_disp_ctrl  = hd_disp_ctrl;
+  hd_wave_entry_mode = hd_entry_mode;
+#endif
+#if defined( LCD_MARQUEE_SUPPORT ) || defined( LCD_PAGE_SUPPORT )
+  hd_wave_shift      = hd_shift;
+#endif
+#ifdef LCD_PAGE_SUPPORT
+  hd_wave_page_draw  = hd_page_draw;
+#endif
+#ifdef LCD_RIGHT_ALIGN_SUPPORT
+  hd_wave_right_dec  = hd_right_dec;
+#endif
+}
+
+
+/** Empty a waveform that will not play and undo its tracking.
+  *
+  * Modes and shift go back to how they were before the first append.
+  * The cells the waveform would have written, and the address counter,
+  * become unknown, so the next LCD_Flush() rewrites them.
+  *
+  * @retval none
+  */
+static void LCD_WaveDrop( void )
+{
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  uint8_t cell;
+#endif
+
+  if( hd_wave_len == 0 ) return;
+
+  hd_wave_len = 0;
+
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  for( cell = 0; cell < sizeof( hd_fb_stale ); cell++ ) hd_fb_stale[ cell ] |= hd_wave_cells[ cell ];
+  hd_fb_ac      = LCD_CELL_UNKNOWN;
+  hd_fb_entry   = hd_wave_fb_entry;
+#endif
+#ifdef LCD_RECOVER_SUPPORT
+  hd_disp_ctrl  = hd_wave_disp_ctrl;
+  hd_entry_mode = hd_wave_entry_mode;
+#endif
+#if defined( LCD_MARQUEE_SUPPORT ) || defined( LCD_PAGE_SUPPORT )
+  hd_shift      = hd_wave_shift;
+#endif
+#ifdef LCD_PAGE_SUPPORT
+  hd_page_draw  = hd_wave_page_draw;
+#endif
+#ifdef LCD_RIGHT_ALIGN_SUPPORT
+  hd_right_dec  = hd_wave_right_dec;
+#endif
+}
+
+
+/** Append one bus write and the wait for it to execute.
+  *
+  * Each transfer is a bus word, E high and E low, one tick each.  The
+  * idle ticks after the last E fall cover exec_us before the next
+  * transfer's E rise.
+  *
+  * @param rs: INSTR_REG or DATA_REG
+  * @param value: byte to write
+  * @param exec_us: controller execution time
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if it did not fit
+  */
+static uint8_t LCD_WaveByte( uint8_t rs, uint8_t value, uint16_t exec_us )
+{
+  uint16_t idle = LCD_WAVE_TICKS( exec_us ),
+           need;
+
+#ifdef LCD_BUS4BIT
+  need = 6;
+#else
+  need = 3;
+#endif
+  idle = ( idle > 2 ) ? idle - 2 : 0;
+
+  if( hd_wave_busy ) return LCD_RESULT_ERROR;
+  if( hd_wave_len + need + idle > LCD_WAVE_WORDS ) return LCD_RESULT_ERROR;
+
+  if( hd_wave_len == 0 ) LCD_WaveSave();
+
+  hd_wave[ hd_wave_len++ ] = LCD_WaveBus( rs, value );
+  hd_wave[ hd_wave_len++ ] = LCD_WAVE_E_HIGH;
+  hd_wave[ hd_wave_len++ ] = LCD_WAVE_E_LOW;
+
+#ifdef LCD_BUS4BIT
+  hd_wave[ hd_wave_len++ ] = LCD_WaveBus( rs, value << 4 );
+  hd_wave[ hd_wave_len++ ] = LCD_WAVE_E_HIGH;
+  hd_wave[ hd_wave_len++ ] = LCD_WAVE_E_LOW;
+#endif
+
+  while( idle-- ) hd_wave[ hd_wave_len++ ] = 0;
+
+  return LCD_RESULT_OK;
+}
+
+
+/** Empty the waveform without playing it.
+  *
+  * @retval none
+  */
+void LCD_WaveReset( void )
+{
+  if( hd_wave_busy ) return;
+
+  LCD_WaveDrop();
+}
+
+
+/** Append an instruction to the waveform.
+  *
+  * The driver's tracking of the display follows as if it were sent now,
+  * except that the frame buffer takes the change once it has played.
+  *
+  * @param cmd: instruction byte
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if full or playing
+  */
+uint8_t LCD_WaveCommand( uint8_t cmd )
+{
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  uint8_t  cell;
+#endif
+  uint16_t exec_us = ( cmd & ~( CLR_DISP | RET_HOME ) ) ? LCD_BUSY_EXEC_US : LCD_BUSY_CLEAR_US;
+
+  if( LCD_WaveByte( INSTR_REG, cmd, exec_us ) != LCD_RESULT_OK ) return LCD_RESULT_ERROR;
+
+  LCD_STAT_COMMAND();
+  LCD_TRACE( 0, cmd );
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  if( cmd == CLR_DISP )
+  {
+    for( cell = 0; cell < sizeof( hd_wave_cells ); cell++ ) hd_wave_cells[ cell ] = 0xFF;
+  }
+  hd_fb_flushing = 1;
+  LCD_TRACK_COMMAND( cmd );
+  hd_fb_flushing = 0;
+#endif
+  LCD_TRACK_MODES( cmd );
+  LCD_TRACK_SHIFT( cmd );
+  LCD_TRACK_ENTRY( cmd );
+
+  return LCD_RESULT_OK;
+}
+
+
+/** Append a data write to the waveform.
+  *
+  * An incrementing entry mode instruction goes first if
+  * LCD_PutNumberRight() left the controller decrementing.
+  *
+  * @param dat: byte for DDRAM or CGRAM
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if full or playing
+  */
+uint8_t LCD_WaveData( uint8_t dat )
+{
+#ifdef LCD_RIGHT_ALIGN_SUPPORT
+  if( hd_right_dec && LCD_WaveCommand( ENT_MODE | INC ) != LCD_RESULT_OK ) return LCD_RESULT_ERROR;
+#endif
+
+  if( LCD_WaveByte( DATA_REG, dat, LCD_BUSY_DATA_US ) != LCD_RESULT_OK ) return LCD_RESULT_ERROR;
+
+  LCD_STAT_DATA();
+  LCD_TRACE( LCD_TRACE_RS, dat );
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  if( hd_fb_ac != LCD_CELL_UNKNOWN ) hd_wave_cells[ hd_fb_ac >> 3 ] |= 1u << ( hd_fb_ac & 7u );
+  hd_fb_flushing = 1;
+  LCD_TRACK_DATA( dat );
+  hd_fb_flushing = 0;
+#endif
+
+  return LCD_RESULT_OK;
+}
+
+
+/** Append a string written at a display position.
+  *
+  * Characters are written as they are, with no cursor movement, control
+  * characters or wrapping.  Nothing is appended unless all of it fits.
+  *
+  * @param x: X coordinate (0 to XMAX)
+  * @param y: Y coordinate (0 to YMAX)
+  * @param string: text to write
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if full or playing
+  */
+uint8_t LCD_WaveWrite( uint8_t x, uint8_t y, const char * string )
+{
+  uint16_t length = 0,
+           commands = 1;
+
+  if( string == NULL ) return LCD_RESULT_ERROR;
+
+  while( string[ length ] ) length++;
+
+#ifdef LCD_RIGHT_ALIGN_SUPPORT
+  if( hd_right_dec ) commands++;
+#endif
+
+  if( hd_wave_len + ( length + commands ) * ( LCD_WAVE_TICKS( LCD_BUSY_DATA_US ) + 6u ) > LCD_WAVE_WORDS )
+  {
+    return LCD_RESULT_ERROR;
+  }
+
+  if( LCD_WaveCommand( SET_DDRAM_ADD | LCD_DDRAM_Addr( x, y ) ) != LCD_RESULT_OK ) return LCD_RESULT_ERROR;
+
+  while( *string )
+  {
+    if( LCD_WaveData( ( uint8_t )*string++ ) != LCD_RESULT_OK ) return LCD_RESULT_ERROR;
+  }
+
+  return LCD_RESULT_OK;
+}
+
+
+/** Return the waveform built so far.
+  *
+  * @param count: receives the number of words, may be NULL
+  * @retval const uint32_t *: first word
+  */
+const uint32_t * LCD_WaveWords( uint16_t * count )
+{
+  if( count != NULL ) *count = hd_wave_len;
+
+  return hd_wave;
+}
+
+
+#ifdef LCD_WAVE_PLAY
+
+/** Called from the DMA interrupt when the waveform has played.
+  *
+  * @retval none
+  */
+static void LCD_WaveDone( void )
+{
+  void ( *done )( void ) = hd_wave_done;
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  uint8_t cell;
+
+  /* The frame takes what the waveform wrote now that it is on the glass. */
+  for( cell = 0; cell < LCD_DDRAM_CELLS; cell++ )
+  {
+    if( hd_wave_cells[ cell >> 3 ] & ( 1u << ( cell & 7u ) ) ) hd_fb_frame[ cell ] = hd_fb_glass[ cell ];
+  }
+#endif
+
+  hd_wave_len  = 0;
+  hd_wave_busy = 0;
+  if( done != NULL ) done();
+}
+
+#endif
+
+
+/** Start playing the waveform.
+  *
+  * Waits for the controller to finish any instruction sent the ordinary
+  * way, then hands the bus to the DMA.  The waveform is emptied once it
+  * has played, or dropped as by LCD_WaveReset() if it cannot play.
+  *
+  * @param done: called from the DMA interrupt at the end, or NULL
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if there is no
+  *                  player, the pins span more than one port or the
+  *                  controller timed out
+  */
+uint8_t LCD_WaveStart( void ( *done )( void ) )
+{
+#ifdef LCD_WAVE_PLAY
+  GPIO_TypeDef * const banks[] =
+  {
+    LCD_D7_BANK, LCD_D6_BANK, LCD_D5_BANK, LCD_D4_BANK,
+#ifdef LCD_BUS8BIT
+    LCD_D3_BANK, LCD_D2_BANK, LCD_D1_BANK, LCD_D0_BANK,
+#endif
+    LCD_RS_BANK, LCD_RNW_BANK
+  };
+  uint8_t bank;
+
+  if( hd_wave_busy || hd_wave_len == 0 ) return LCD_RESULT_ERROR;
+
+  for( bank = 0; bank < sizeof( banks ) / sizeof( banks[ 0 ] ); bank++ )
+  {
+    if( banks[ bank ] != LCD_E_BANK )
+    {
+      LCD_WaveDrop();
+      return LCD_RESULT_ERROR;
+    }
+  }
+
+  if( !LCD_BusyWait() )
+  {
+    LCD_WaveDrop();
+    return LCD_RESULT_ERROR;
+  }
+
+  /* Leave every bus pin driven, as the DMA only writes output levels. */
+  LCD_SetRNW( WRITE );
+  LCD_Output( 0 );
+
+  hd_wave_done = done;
+  hd_wave_busy = 1;
+  LCD_BUSY_MARK( LCD_BUSY_UNKNOWN );
+
+  if( !LCD_WAVE_PLAY( LCD_E_BANK, hd_wave, hd_wave_len, LCD_WaveDone ) )
+  {
+    hd_wave_busy = 0;
+    LCD_WaveDrop();
+    return LCD_RESULT_ERROR;
+  }
+
+  return LCD_RESULT_OK;
+#else
+  ( void )done;
+
+  if( !hd_wave_busy ) LCD_WaveDrop();
+
+  return LCD_RESULT_ERROR;
+#endif
+}
+
+
+/** Report whether a waveform is playing.
+  *
+  * @retval uint8_t: 1 while the DMA owns the bus, otherwise 0
+  */
+uint8_t LCD_WaveBusy( void )
+{
+  return hd_wave_busy;
+}
+
+#endif
+
+
+#ifdef LCD_VT100_SUPPORT
+
+/** Blank part of one row without moving the cursor.
+  *
+  * @param y: row
+  * @param from: first column
+  * @param to: last column
+  * @retval none
+  */
+static void LCD_VT100_Blank( uint8_t y, uint8_t from, uint8_t to )
+{
+  for( ; from <= to && from <= XMAX; from++ ) LCD_WriteCell( LCD_DDRAM_Addr( from, y ), ' ' );
+}
+
+
+/** Carry out a complete control sequence.
+  *
+  * @param final: final byte of the sequence
+  * @retval none
+  */
+static void LCD_VT100_Execute( uint8_t final )
+{
+  uint8_t n = hd_vt_param[ 0 ] ? hd_vt_param[ 0 ] : 1,
+          x = hd_xpos,
+          y = hd_ypos,
+          row;
+
+  switch( final )
+  {
+    case 'H':                             // CUP, 1-based row and column
+    case 'f':
+      y = hd_vt_param[ 0 ] ? hd_vt_param[ 0 ] - 1 : 0;
+      x = hd_vt_param[ 1 ] ? hd_vt_param[ 1 ] - 1 : 0;
+      break;
+
+    case 'A': y = ( y > n ) ? y - n : 0; break;
+    case 'B': y = ( y + n < YMAX ) ? y + n : YMAX; break;
+    case 'C': x = ( x + n < XMAX ) ? x + n : XMAX; break;
+    case 'D': x = ( x > n ) ? x - n : 0; break;
+
+    case 'K':                             // EL
+      if( hd_vt_param[ 0 ] == 0 )      LCD_VT100_Blank( y, x, XMAX );
+      else if( hd_vt_param[ 0 ] == 1 ) LCD_VT100_Blank( y, 0, x );
+      else                             LCD_VT100_Blank( y, 0, XMAX );
+      break;
+
+    case 'J':                             // ED
+      if( hd_vt_param[ 0 ] == 2 )
+      {
+        LCD_Clear();
+        break;
+      }
+      for( row = 0; row <= YMAX; row++ )
+      {
+        if( hd_vt_param[ 0 ] == 0 && row > y )      LCD_VT100_Blank( row, 0, XMAX );
+        else if( hd_vt_param[ 0 ] == 1 && row < y ) LCD_VT100_Blank( row, 0, XMAX );
+      }
+      if( hd_vt_param[ 0 ] == 0 ) LCD_VT100_Blank( y, x, XMAX );
+      else                        LCD_VT100_Blank( y, 0, x );
+      break;
+
+    case 's':                             // SCOSC
+      hd_vt_saved_x = x;
+      hd_vt_saved_y = y;
+      return;
+
+    case 'u':                             // SCORC
+      x = hd_vt_saved_x;
+      y = hd_vt_saved_y;
+      break;
+
+    default:                              // SGR and the rest are ignored
+      return;
+  }
+
+  LCD_Locate( x > XMAX ? XMAX : x, y > YMAX ? YMAX : y );
+}
+
+
+/** Write one character code at the cursor.
+  *
+  * Every path that moves the cursor leaves the address counter on it, so
+  * while the next column follows on in DDRAM a character is a single data
+  * write, as in LCD_ConsolePutc().  The end of a row and presentation mode
+  * go through LCD_PutCode().
+  *
+  * @param ch: character code, already translated for the ROM
+  * @retval none
+  */
+static void LCD_VT100_PutCode( uint8_t ch )
+{
+  uint8_t next = hd_xpos + 1;
+
+  if( hd_wrap_pending || next > XMAX || ch == '\r' || ch == '\n'
+#ifdef LCD_PRESENT_SUPPORT
+      || hd_presenting
+#endif
+      || LCD_DDRAM_Addr( next, hd_ypos ) != LCD_DDRAM_Addr( hd_xpos, hd_ypos ) + 1 )
+  {
+    LCD_PutCode( ch );
+    return;
+  }
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  LCD_PutData( ch );
+  hd_xpos = next;
+}
+
+
+/** Write one printable byte at the cursor.
+  *
+  * @param byte: byte of text, UTF-8 when LCD_UTF8_SUPPORT is defined
+  * @retval none
+  */
+static void LCD_VT100_Print( uint8_t byte )
+{
+#ifdef LCD_UTF8_SUPPORT
+  uint8_t codes[ 2 ],
+          count,
+          index;
+
+  count = LCD_UTF8_Translate( byte, codes );
+  for( index = 0; index < count; index++ ) LCD_VT100_PutCode( codes[ index ] );
+#else
+  LCD_VT100_PutCode( byte );
+#endif
+}
+
+
+/** Feed one byte through the VT100 parser.
+  *
+  * Text is written at the cursor, the \r and \n controls go to
+  * LCD_Putchar(), backspace moves left, and other controls are ignored.
+  *
+  * @param byte: next byte of the stream
+  * @retval none
+  */
+void LCD_VT100_Write( uint8_t byte )
+{
+  uint8_t index;
+
+  if( byte == 0x18 || byte == 0x1A )     // CAN and SUB abandon a sequence
+  {
+    hd_vt_state = LCD_VT_GROUND;
+    return;
+  }
+
+  if( byte == 0x1B )
+  {
+    hd_vt_state = LCD_VT_ESCAPE;
+    return;
+  }
+
+  switch( hd_vt_state )
+  {
+    case LCD_VT_ESCAPE:
+      hd_vt_state = LCD_VT_GROUND;
+
+      if( byte == '[' )
+      {
+        hd_vt_state  = LCD_VT_CSI;
+        hd_vt_nparam = 0;
+        for( index = 0; index < LCD_VT_PARAMS; index++ ) hd_vt_param[ index ] = 0;
+      }
+      else if( byte == '7' )             // DECSC
+      {
+        hd_vt_saved_x = hd_xpos;
+        hd_vt_saved_y = hd_ypos;
+      }
+      else if( byte == '8' )             // DECRC
+      {
+        LCD_Locate( hd_vt_saved_x, hd_vt_saved_y );
+      }
+      else if( byte == 'c' )             // RIS
+      {
+        LCD_Clear();
+      }
+      break;
+
+    case LCD_VT_CSI:
+    case LCD_VT_CSI_IGNORE:
+      if( byte >= '0' && byte <= '9' )
+      {
+        uint16_t value = hd_vt_param[ hd_vt_nparam ] * 10u + ( byte - '0' );
+
+        hd_vt_param[ hd_vt_nparam ] = ( value > 255 ) ? 255 : value;
+      }
+      else if( byte == ';' )
+      {
+        if( hd_vt_nparam < LCD_VT_PARAMS - 1 ) hd_vt_nparam++;
+      }
+      else if( byte >= 0x40 && byte <= 0x7E )
+      {
+        if( hd_vt_state == LCD_VT_CSI ) LCD_VT100_Execute( byte );
+        hd_vt_state = LCD_VT_GROUND;
+      }
+      else if( byte >= 0x20 )
+      {
+        hd_vt_state = LCD_VT_CSI_IGNORE;
+      }
+      break;
+
+    default:
+      if( byte == '\b' )
+      {
+        if( hd_xpos ) LCD_Locate( hd_xpos - 1, hd_ypos );
+      }
+      else if( byte >= 0x20 )
+      {
+        LCD_VT100_Print( byte );
+      }
+      else if( byte == '\r' || byte == '\n' )
+      {
+        LCD_Putchar( byte );
+      }
+      break;
+  }
+}
+
+
+/** Queue one received byte.  Call from the UART receive interrupt.
+  *
+  * @param byte: received byte
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if the ring is full
+  */
+uint8_t LCD_VT100_Receive( uint8_t byte )
+{
+  uint16_t head = hd_vt_head;
+
+  if( ( uint16_t )( head - hd_vt_tail ) >= LCD_VT100_RX_SIZE ) return LCD_RESULT_ERROR;
+
+  hd_vt_rx[ head & ( LCD_VT100_RX_SIZE - 1 ) ] = byte;
+  LCD_MEMORY_BARRIER();
+  hd_vt_head = head + 1;
+
+  return LCD_RESULT_OK;
+}
+
+
+/** Parse and display queued bytes.  Call from the main loop.
+  *
+  * @param max_bytes: most bytes to handle, 0 for all that are queued
+  * @retval uint16_t: number of bytes handled
+  */
+uint16_t LCD_VT100_Service( uint16_t max_bytes )
+{
+  uint16_t tail = hd_vt_tail,
+           done = 0;
+
+  while( tail != hd_vt_head && ( max_bytes == 0 || done < max_bytes ) )
+  {
+    LCD_MEMORY_BARRIER();
+    LCD_VT100_Write( hd_vt_rx[ tail & ( LCD_VT100_RX_SIZE - 1 ) ] );
+    hd_vt_tail = ++tail;
+    done++;
+  }
+
+  return done;
+}
+
+#endif
+
+
+#ifdef LCD_RIGHT_ALIGN_SUPPORT
+
+/** Follow entry mode changes.
+  *
+  * @param cmd: instruction about to be sent
+  * @retval none
+  */
+static void LCD_TrackEntry( uint8_t cmd )
+{
+  if( ( cmd & 0xFC ) == ENT_MODE )
+  {
+    hd_right_dec = !( cmd & INC );
+  }
+  else if( cmd == CLR_DISP )
+  {
+    hd_right_dec = 0;
+  }
+}
+
+
+/** Put the incrementing entry mode back before a data write that is
+  * not part of a right-aligned field.
+  *
+  * @retval none
+  */
+static void LCD_EntryRestore( void )
+{
+  if( hd_right_dec && !hd_right_own ) LCD_Command( ENT_MODE | INC );
+}
+
+
+/** Write one cell of a right-aligned field.
+  *
+  * @param x: column
+  * @param y: row
+  * @param ch: character code
+  * @param next: address counter after the previous cell, updated
+  * @retval none
+  */
+static void LCD_RightCell( uint8_t x, uint8_t y, uint8_t ch, uint8_t * next )
+{
+  uint8_t addr = LCD_DDRAM_Addr( x, y );
+
+#ifdef LCD_PRESENT_SUPPORT
+  if( hd_presenting )
+  {
+    LCD_WriteCell( addr, ch );
+    return;
+  }
+#endif
+
+  if( addr != *next ) LCD_Command( SET_DDRAM_ADD | addr );
+  LCD_PutData( ch );
+  *next = addr - 1;
+}
+
+
+/** Write a decimal number that ends at a given column.
+  *
+  * Digits come straight from the conversion, least significant first,
+  * then the sign, then spaces up to the width.  Output stops at column
+  * 0 if the number does not fit.
+  *
+  * @param x: column of the last digit
+  * @param y: row
+  * @param value: number to show
+  * @param width: minimum field width, padded with spaces on the left
+  * @retval none
+  */
+void LCD_PutNumberRight( uint8_t x, uint8_t y, int32_t value, uint8_t width )
+{
+  uint32_t magnitude = ( value < 0 ) ? 0u - ( uint32_t )value : ( uint32_t )value;
+  uint8_t  negative  = ( value < 0 ),
+           written   = 0,
+           next      = 0xFF,
+           ch;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+  if( x > XMAX || y > YMAX ) return;
+
+  hd_right_own = 1;
+
+#ifdef LCD_PRESENT_SUPPORT
+  if( !hd_presenting )
+#endif
+  {
+    if( !hd_right_dec ) LCD_Command( ENT_MODE | DEC );
+  }
+
+  for( ;; )
+  {
+    if( magnitude || !written )
+    {
+      ch = '0' + magnitude % 10;
+      magnitude /= 10;
+    }
+    else if( negative )
+    {
+      ch = '-';
+      negative = 0;
+    }
+    else if( written < width )
+    {
+      ch = ' ';
+    }
+    else break;
+
+    LCD_RightCell( x, y, ch, &next );
+    written++;
+
+    if( x == 0 ) break;
+    x--;
+  }
+
+  LCD_SyncCursor();
+  hd_right_own = 0;
+}
+
+#endif
+
+
+#ifdef LCD_CONSOLE_SUPPORT
+
+/** Work out which line a panel row should show.
+  *
+  * @param row: panel row
+  * @param seq: receives the line's sequence number
+  * @retval uint8_t: LCD_CON_ROW_LINE, or LCD_CON_ROW_BLANK when no line
+  *                  belongs there
+  */
+static uint8_t LCD_ConsoleTarget( uint8_t row, uint32_t * seq )
+{
+  uint16_t age;
+
+  if( ( hd_con_flags & LCD_CONSOLE_ROLL ) && hd_con_back == 0 )
+  {
+    age = ( hd_con_seq % LCD_CON_ROWS + LCD_CON_ROWS - row ) % LCD_CON_ROWS;
+  }
+  else
+  {
+    age = hd_con_back + ( LCD_CON_ROWS - 1 - row );
+  }
+
+  if( age >= hd_con_count ) return LCD_CON_ROW_BLANK;
+
+  *seq = hd_con_seq - age;
+  return LCD_CON_ROW_LINE;
+}
+
+
+/** Rewrite the rows whose line has changed, then restore the cursor
+  * if anything was written.
+  *
+  * @retval none
+  */
+static void LCD_ConsoleRender( void )
+{
+  const uint8_t * text;
+  uint32_t        seq = 0;
+  uint8_t         row,
+                  col,
+                  state,
+                  addr,
+                  next,
+                  written = 0;
+
+  for( row = 0; row < LCD_CON_ROWS; row++ )
+  {
+    state = LCD_ConsoleTarget( row, &seq );
+
+    if( state == hd_con_row_state[ row ] && ( state == LCD_CON_ROW_BLANK || seq == hd_con_row_seq[ row ] ) ) continue;
+
+    text = hd_con_text[ seq % LCD_CONSOLE_LINES ];
+    next = 0xFF;
+
+    for( col = 0; col < LCD_CON_WIDTH; col++ )
+    {
+      addr = LCD_DDRAM_Addr( col, row );
+      if( addr != next ) LCD_Command( SET_DDRAM_ADD | addr );
+      LCD_PutData( ( state == LCD_CON_ROW_LINE ) ? text[ col ] : ' ' );
+      next = addr + 1;
+    }
+
+    hd_con_row_state[ row ] = state;
+    hd_con_row_seq[ row ]   = seq;
+    written = 1;
+  }
+
+  if( written ) LCD_SyncCursor();
+}
+
+
+/** Start the console with an empty history.
+  *
+  * Every row is rewritten on the first update.
+  *
+  * @param flags: LCD_CONSOLE_ORDERED or LCD_CONSOLE_ROLL
+  * @retval none
+  */
+void LCD_ConsoleInit( uint8_t flags )
+{
+  uint8_t row,
+          col;
+
+  hd_con_flags = flags;
+  hd_con_seq   = 0;
+  hd_con_count = 1;
+  hd_con_back  = 0;
+  hd_con_col   = 0;
+
+  for( col = 0; col < LCD_CON_WIDTH; col++ ) hd_con_text[ 0 ][ col ] = ' ';
+  for( row = 0; row < LCD_CON_ROWS; row++ ) hd_con_row_state[ row ] = LCD_CON_ROW_UNKNOWN;
+
+  LCD_Locate( 0, ( flags & LCD_CONSOLE_ROLL ) ? 0 : YMAX );
+  LCD_ConsoleRender();
+}
+
+
+/** Write one character to the console.
+  *
+  * '\n' starts a new line, '\r' returns to its start, and a full line
+  * wraps.  A character on a visible line is usually one data write,
+  * as the cursor is already there.  While
+  * scrolled back the view stays put.
+  *
+  * @param ch: character code
+  * @retval none
+  */
+void LCD_ConsolePutc( uint8_t ch )
+{
+  uint8_t * text;
+  uint32_t  seq;
+  uint8_t   row,
+            col;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  if( ch == '\r' )
+  {
+    hd_con_col = 0;
+    return;
+  }
+
+  if( ch == '\n' || hd_con_col > XMAX )
+  {
+    hd_con_seq++;
+    hd_con_col = 0;
+    if( hd_con_count < LCD_CONSOLE_LINES ) hd_con_count++;
+    if( hd_con_back && hd_con_back + LCD_CON_ROWS < hd_con_count ) hd_con_back++;
+
+    text = hd_con_text[ hd_con_seq % LCD_CONSOLE_LINES ];
+    for( col = 0; col < LCD_CON_WIDTH; col++ ) text[ col ] = ' ';
+
+    LCD_ConsoleRender();
+    if( ch == '\n' ) return;
+  }
+
+  hd_con_text[ hd_con_seq % LCD_CONSOLE_LINES ][ hd_con_col ] = ch;
+
+  for( row = 0; row < LCD_CON_ROWS; row++ )
+  {
+    if( LCD_ConsoleTarget( row, &seq ) == LCD_CON_ROW_LINE && seq == hd_con_seq )
+    {
+      if( hd_xpos != hd_con_col || hd_ypos != row ) LCD_Locate( hd_con_col, row );
+      LCD_PutData( ch );
+
+      col = hd_con_col + 1;
+      if( col <= XMAX && LCD_DDRAM_Addr( col, row ) == LCD_DDRAM_Addr( hd_con_col, row ) + 1 ) hd_xpos = col;
+      else LCD_Locate( ( col <= XMAX ) ? col : XMAX, row );
+    }
+  }
+
+  hd_con_col++;
+}
+
+
+/** Write a string to the console.
+  *
+  * @param string: null-terminated string
+  * @retval none
+  */
+void LCD_ConsolePuts( const char * string )
+{
+  if( string == NULL ) return;
+
+  while( *string ) LCD_ConsolePutc( ( uint8_t )*string++ );
+}
+
+
+/** Move the view through the history.
+  *
+  * @param lines: lines to go back, or forward if negative; the view
+  *               stops at the oldest line and at the live view
+  * @retval none
+  */
+void LCD_ConsoleScroll( int16_t lines )
+{
+  int32_t back = ( int32_t )hd_con_back + lines,
+          most = ( hd_con_count > LCD_CON_ROWS ) ? hd_con_count - LCD_CON_ROWS : 0;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  if( back < 0 )    back = 0;
+  if( back > most ) back = most;
+  if( back == hd_con_back ) return;
+
+  hd_con_back = ( uint16_t )back;
+  LCD_ConsoleRender();
+}
+
+#endif
+
+
+#ifdef LCD_PAGE_SUPPORT
+
+/** Select the page that drawing goes to.
+  *
+  * LCD_Locate(), LCD_DDRAM_Addr() and everything built on them address
+  * this page from then on, whether or not it is shown.
+  *
+  * @param page: page number, 0 to LCD_PageCount() - 1
+  * @retval none
+  */
+void LCD_PageDraw( uint8_t page )
+{
+  if( page >= LCD_PAGES ) return;
+
+  hd_page_draw = page;
+  LCD_SyncCursor();
+}
+
+
+/** Show a page and draw to it from then on.
+  *
+  * The page is brought into view with display shift instructions, or a
+  * single RET_HOME for page 0 when the cost model says that is cheaper.
+  * DDRAM is not written.
+  *
+  * @param page: page number, 0 to LCD_PageCount() - 1
+  * @retval none
+  */
+void LCD_PageShow( uint8_t page )
+{
+  uint8_t target,
+          left,
+          right;
+
+  if( page >= LCD_PAGES ) return;
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  target = page * LCD_PAGE_STRIDE;
+  left   = ( target + LCD_SHIFT_SPAN - hd_shift ) % LCD_SHIFT_SPAN;
+  right  = left ? LCD_SHIFT_SPAN - left : 0;
+
+  if( target == 0 && left &&
+      LCD_COST_CLEAR_US < ( left < right ? left : right ) * ( uint32_t )( LCD_COST_XFER_US + LCD_COST_EXEC_US ) )
+  {
+    LCD_Command( RET_HOME );
+  }
+  else if( left <= right )
+  {
+    while( left-- ) LCD_Command( CURS_DISP_SH | DIS_SHIFT );
+  }
+  else
+  {
+    while( right-- ) LCD_Command( CURS_DISP_SH | DIS_SHIFT | RIGHT );
+  }
+
+  hd_page_draw = page;
+  LCD_SyncCursor();
+}
+
+
+/** Return the page currently shown.
+  *
+  * @retval uint8_t: page number, or 0xFF if the display is shifted to
+  *                  somewhere between pages
+  */
+uint8_t LCD_PageShown( void )
+{
+  return ( hd_shift % LCD_PAGE_STRIDE ) ? 0xFF : hd_shift / LCD_PAGE_STRIDE;
+}
+
+
+/** Return the number of pages the panel has room for.
+  *
+  * @retval uint8_t: page count
+  */
+uint8_t LCD_PageCount( void )
+{
+  return LCD_PAGES;
+}
+
+#endif
+
+
+#ifdef LCD_PRINTF_SUPPORT
+/** Format a string and write it to the LCD.
+  *
+  * Output is truncated to LCD_PRINTF_BUFFER_SIZE - 1 characters.
+  *
+  * @param format: printf-style format string
+  * @retval int: number of characters that would have been written,
+  *              or a negative value on formatting error.
+  */
+int LCD_Printf( const char * format, ... )
+{
+  char buffer[ LCD_PRINTF_BUFFER_SIZE ];
+  va_list args;
+  int chars_formatted;
+
+  if( format == NULL ) return -1;
+
+  va_start( args, format );
+  chars_formatted = vsnprintf( buffer, sizeof( buffer ), format, args );
+  va_end( args );
+
+  if( chars_formatted < 0 ) return chars_formatted;
+
+  LCD_Puts( buffer );
+  return chars_formatted;
+}
+#endif
+
+/* CrossWorks ARM printf support */
+#ifdef __CROSSWORKS_ARM
+int __putchar(int ch, __printf_tag_ptr ptr)
+{
+  return LCD_Putchar( ch );
+}
+#endif
+
+/* GNU putchar support. (Some might prefer _write instead) */
+#if defined(__GNUC__) && !defined(__CROSSWORKS_ARM)
+
+PUTCHAR_PROTOTYPE
+{
+  LCD_Putchar( ch );
+  return ch;
+}
+#endif
+
+
+/** Clear the LCD display
+  *
+  * @param none
+  * @retval none
+  */
+void LCD_Clear(void)
+{
+#ifdef LCD_PRESENT_SUPPORT
+  if( hd_presenting )
+  {
+    LCD_FB_Clear();
+    LCD_Locate( 0, 0 );
+    return;
+  }
+#endif
+
+  if( !LCD_BusyWait() ) return;
+  LCD_Command(CLR_DISP);
+  hd_wrap_pending = 0;
+
+  /* CLR_DISP leaves the address counter at 0, so unless the page moves
+     the home cell the clear can run on while the caller carries on. */
+  if( LCD_DDRAM_Addr( 0, 0 ) )
+  {
+    LCD_Locate( 0, 0 );
+  }
+  else
+  {
+    hd_xpos = 0;
+    hd_ypos = 0;
+  }
+}
+
+
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+
+/** Convert a DDRAM address to a frame buffer cell index.
+  *
+  * @param addr: DDRAM address
+  * @retval uint8_t: cell index, or LCD_CELL_UNKNOWN for a hole in the map
+  */
+static uint8_t LCD_CellIndex( uint8_t addr )
+{
+  addr &= 0x7F;
+
+  if( NUMLINES == TWOLINES )
+  {
+    if( ( addr & 0x3F ) >= LCD_DDRAM_LINE ) return LCD_CELL_UNKNOWN;
+    if( addr & 0x40 ) return ( addr & 0x3F ) + LCD_DDRAM_LINE;
+  }
+  else if( addr >= LCD_DDRAM_CELLS ) return LCD_CELL_UNKNOWN;
+
+  return addr;
+}
+
+
+/** Convert a frame buffer cell index back to its DDRAM address.
+  *
+  * @param cell: cell index
+  * @retval uint8_t: DDRAM address
+  */
+static uint8_t LCD_CellAddr( uint8_t cell )
+{
+  if( NUMLINES == TWOLINES && cell >= LCD_DDRAM_LINE ) return 0x40 | ( cell - LCD_DDRAM_LINE );
+
+  return cell;
+}
+
+
+/** Step a cell index the way the address counter moves.
+  *
+  * @param cell: current cell index
+  * @param forward: non-zero to increment, zero to decrement
+  * @retval uint8_t: next cell index
+  */
+static uint8_t LCD_CellStep( uint8_t cell, uint8_t forward )
+{
+  if( cell == LCD_CELL_UNKNOWN ) return cell;
+  if( forward ) return ( cell + 1 ) % LCD_DDRAM_CELLS;
+
+  return cell ? cell - 1u : LCD_DDRAM_CELLS - 1u;
+}
+
+
+/** Follow the effect of an instruction on DDRAM and the address counter.
+  *
+  * @param cmd: instruction just sent
+  * @retval none
+  */
+static void LCD_TrackCommand( uint8_t cmd )
+{
+  uint8_t cell;
+
+  if( cmd & SET_DDRAM_ADD )
+  {
+    hd_fb_ac = LCD_CellIndex( cmd );
+  }
+  else if( cmd & SET_CGRAM_ADD )
+  {
+    hd_fb_ac = LCD_CELL_UNKNOWN;
+  }
+  else if( cmd & ( FUNC_SET | DISP_CTRL ) )
+  {
+    return;
+  }
+  else if( cmd & CURS_DISP_SH )
+  {
+    if( !( cmd & DIS_SHIFT ) ) hd_fb_ac = LCD_CellStep( hd_fb_ac, cmd & RIGHT );
+  }
+  else if( cmd & ENT_MODE )
+  {
+    hd_fb_entry = cmd;
+  }
+  else if( cmd & RET_HOME )
+  {
+    hd_fb_ac = 0;
+  }
+  else if( cmd & CLR_DISP )
+  {
+    for( cell = 0; cell < LCD_DDRAM_CELLS; cell++ )
+    {
+      hd_fb_glass[ cell ] = ' ';
+      if( !hd_fb_flushing ) hd_fb_frame[ cell ] = ' ';
+    }
+    for( cell = 0; cell < sizeof( hd_fb_stale ); cell++ ) hd_fb_stale[ cell ] = 0;
+    hd_fb_ac    = 0;
+    hd_fb_entry = ENT_MODE | INC;
+  }
+}
+
+
+/** Follow a data write.  Writes made outside LCD_Flush() also land in
+  * the frame so that a later flush does not undo them.
+  *
+  * @param dat: byte just written
+  * @retval none
+  */
+static void LCD_TrackData( uint8_t dat )
+{
+  if( hd_fb_ac == LCD_CELL_UNKNOWN ) return;
+
+  hd_fb_glass[ hd_fb_ac ] = dat;
+  LCD_GLASS_KNOWN( hd_fb_ac );
+  if( !hd_fb_flushing ) hd_fb_frame[ hd_fb_ac ] = dat;
+
+  hd_fb_ac = LCD_CellStep( hd_fb_ac, hd_fb_entry & INC );
+}
+
+
+#ifdef LCD_READ_DD_SUPPORT
+/** Follow the address counter step caused by a data read.
+  *
+  * @retval none
+  */
+static void LCD_TrackRead( void )
+{
+  hd_fb_ac = LCD_CellStep( hd_fb_ac, hd_fb_entry & INC );
+}
+#endif
+
+
+/** Price, and optionally send, the writes that turn one DDRAM image
+  * into the frame buffer.
+  *
+  * Changed cells are visited in address counter order.  Reaching one
+  * either rewrites the unchanged gap from the address counter, or sets
+  * the address, whichever the cost model says is cheaper.
+  *
+  * @param base: hd_fb_glass, or NULL for a cleared display
+  * @param ac: cell the address counter points at, or LCD_CELL_UNKNOWN
+  * @param first: first cell to consider
+  * @param end: cell after the last one to consider
+  * @param execute: non-zero to send the writes as well as price them
+  * @retval uint32_t: modelled cost in microseconds
+  */
+static uint32_t LCD_FlushPlan( const uint8_t * base, uint8_t ac, uint8_t first, uint8_t end, uint8_t execute )
+{
+  uint32_t cost = 0;
+  uint8_t  cell,
+           gap;
+
+  for( cell = first; cell < end; cell++ )
+  {
+    if( base ? LCD_GLASS_IS( cell, hd_fb_frame[ cell ] ) : hd_fb_frame[ cell ] == ' ' ) continue;
+
+    if( ac != cell )
+    {
+      gap = ( ac < cell ) ? cell - ac : 0;
+
+      if( gap && ( uint32_t )gap * LCD_PLAN_COST_DATA <= LCD_PLAN_COST_COMMAND )
+      {
+        cost += ( uint32_t )gap * LCD_PLAN_COST_DATA;
+        if( execute )
+        {
+          for( ; ac < cell; ac++ ) LCD_PutData( hd_fb_frame[ ac ] );
+        }
+      }
+      else
+      {
+        cost += LCD_PLAN_COST_COMMAND;
+        if( execute ) LCD_Command( SET_DDRAM_ADD | LCD_CellAddr( cell ) );
+      }
+    }
+
+    cost += LCD_PLAN_COST_DATA;
+    if( execute ) LCD_PutData( hd_fb_frame[ cell ] );
+    ac = cell + 1;
+  }
+
+  return cost;
+}
+
+
+/** Choose between a differential update and clear plus sparse writes.
+  *
+  * @param use_clear: set non-zero if clearing first is cheaper and the
+  *                   display is not shifted
+  * @retval uint32_t: modelled cost of the chosen plan in microseconds
+  */
+static uint32_t LCD_FlushChoose( uint8_t * use_clear )
+{
+  uint32_t diff_cost,
+           clear_cost;
+
+  diff_cost  = LCD_FlushPlan( hd_fb_glass, hd_fb_ac, 0, LCD_DDRAM_CELLS, 0 );
+  clear_cost = LCD_PLAN_COST_CLEAR + LCD_FlushPlan( NULL, 0, 0, LCD_DDRAM_CELLS, 0 );
+
+  /* The plan writes in INC order. */
+  if( diff_cost && !( hd_fb_entry & INC ) ) diff_cost += LCD_PLAN_COST_COMMAND;
+
+  *use_clear = clear_cost < diff_cost;
+
+#if defined( LCD_MARQUEE_SUPPORT ) || defined( LCD_PAGE_SUPPORT )
+  /* CLR_DISP also undoes the display shift, moving the page or marquee. */
+  if( hd_shift ) *use_clear = 0;
+#endif
+
+  return *use_clear ? clear_cost : diff_cost;
+}
+
+
+/** Leave the hardware cursor where the character API expects it.
+  *
+  * @retval none
+  */
+static void LCD_FlushRestoreCursor( void )
+{
+  uint8_t cursor_addr = LCD_DDRAM_Addr( hd_xpos, hd_ypos );
+
+  if( hd_fb_ac != LCD_CellIndex( cursor_addr ) ) LCD_Command( SET_DDRAM_ADD | cursor_addr );
+}
+
+
+/** Find the end of the field starting at a changed cell.
+  *
+  * A field is a run of changed cells with gaps of no more than
+  * LCD_FLUSH_FIELD_GAP unchanged cells.  Budgeted flushes send a field
+  * whole or not at all so a multi-character value never shows half old
+  * and half new.
+  *
+  * @param first: changed cell that starts the field
+  * @retval uint8_t: cell after the last changed cell of the field
+  */
+static uint8_t LCD_FlushFieldEnd( uint8_t first )
+{
+  uint8_t cell = first + 1,
+          end  = first + 1;
+
+  while( cell < LCD_DDRAM_CELLS && cell - end <= LCD_FLUSH_FIELD_GAP )
+  {
+    if( !LCD_GLASS_IS( cell, hd_fb_frame[ cell ] ) ) end = cell + 1;
+    cell++;
+  }
+
+  return end;
+}
+
+
+/** Send pending fields until a time or transaction budget runs out.
+  *
+  * @param max_us: time budget, 0 for no time limit
+  * @param max_fields: field budget, 0 for no field limit
+  * @retval uint8_t: LCD_FLUSH_DONE or LCD_FLUSH_PENDING
+  */
+static uint8_t LCD_FlushSlice( uint32_t max_us, uint16_t max_fields )
+{
+  uint32_t started = LCD_Time_us(),
+           elapsed = 0,
+           cost;
+  uint16_t sent    = 0;
+  uint8_t  scanned,
+           cell,
+           end;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_FLUSH_PENDING;
+
+  hd_fb_flushing = 1;
+
+  for( scanned = 0; scanned < LCD_DDRAM_CELLS; )
+  {
+    cell = hd_fb_resume;
+
+    if( LCD_GLASS_IS( cell, hd_fb_frame[ cell ] ) )
+    {
+      hd_fb_resume = ( cell + 1 ) % LCD_DDRAM_CELLS;
+      scanned++;
+      continue;
+    }
+
+    end  = LCD_FlushFieldEnd( cell );
+    cost = LCD_FlushPlan( hd_fb_glass, hd_fb_ac, cell, end, 0 );
+    if( !( hd_fb_entry & INC ) ) cost += LCD_PLAN_COST_COMMAND;
+
+    /* Always make some progress, even if one field overruns the budget. */
+    if( sent && max_us && elapsed + cost > max_us ) break;
+    if( sent && max_fields && sent >= max_fields ) break;
+
+    if( !( hd_fb_entry & INC ) ) LCD_Command( ENT_MODE | INC );
+    LCD_FlushPlan( hd_fb_glass, hd_fb_ac, cell, end, 1 );
+    if( hd_status & LCD_STATUS_TIMEOUT ) break;
+
+    sent++;
+    scanned     += end - cell;
+    hd_fb_resume = end % LCD_DDRAM_CELLS;
+    elapsed      = LCD_Time_us() - started;
+  }
+
+  hd_fb_flushing = 0;
+
+  if( sent ) LCD_FlushRestoreCursor();
+
+  return ( scanned < LCD_DDRAM_CELLS ) ? LCD_FLUSH_PENDING : LCD_FLUSH_DONE;
+}
+
+
+/** Fill the frame buffer with spaces.
+  *
+  * @retval none
+  */
+void LCD_FB_Clear( void )
+{
+  uint8_t cell;
+
+  for( cell = 0; cell < LCD_DDRAM_CELLS; cell++ ) hd_fb_frame[ cell ] = ' ';
+}
+
+
+/** Draw one character into the frame buffer.
+  *
+  * @param x: X coordinate (0 to XMAX)
+  * @param y: Y coordinate (0 to YMAX)
+  * @param ch: character to draw
+  * @retval none
+  */
+void LCD_FB_Putc( uint8_t x, uint8_t y, uint8_t ch )
+{
+  if( x > XMAX || y > YMAX ) return;
+
+  hd_fb_frame[ LCD_CellIndex( LCD_DDRAM_Addr( x, y ) ) ] = ch;
+}
+
+
+/** Draw a string into the frame buffer, clipped at the end of the row.
+  *
+  * @param x: X coordinate of the first character
+  * @param y: Y coordinate
+  * @param string: null-terminated string
+  * @retval none
+  */
+void LCD_FB_Puts( uint8_t x, uint8_t y, const char * string )
+{
+  if( string == NULL ) return;
+
+  while( *string && x <= XMAX )
+  {
+    LCD_FB_Putc( x++, y, ( uint8_t )*string++ );
+  }
+}
+
+
+/** Read one character back from the frame buffer.
+  *
+  * @param x: X coordinate (0 to XMAX)
+  * @param y: Y coordinate (0 to YMAX)
+  * @retval uint8_t: character in the frame, or a space off-panel
+  */
+uint8_t LCD_FB_Getc( uint8_t x, uint8_t y )
+{
+  if( x > XMAX || y > YMAX ) return ' ';
+
+  return hd_fb_frame[ LCD_CellIndex( LCD_DDRAM_Addr( x, y ) ) ];
+}
+
+
+/** Send the frame buffer to the display using the cheaper plan.
+  *
+  * @retval none
+  */
+void LCD_Flush( void )
+{
+  uint8_t use_clear;
+  uint8_t visible = ( XMAX + 1 ) * ( YMAX + 1 );
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+#ifdef LCD_CANVAS_SUPPORT
+  LCD_CanvasUpload();
+#endif
+
+  if( LCD_FlushChoose( &use_clear ) == 0 ) return;
+
+#ifdef LCD_STATS_SUPPORT
+  uint32_t data_before = hd_stats.data_bytes;
+#endif
+
+  hd_fb_flushing = 1;
+
+  if( use_clear )
+  {
+    LCD_Command( CLR_DISP );
+    LCD_FlushPlan( NULL, 0, 0, LCD_DDRAM_CELLS, 1 );
+  }
+  else
+  {
+    if( !( hd_fb_entry & INC ) ) LCD_Command( ENT_MODE | INC );
+    LCD_FlushPlan( hd_fb_glass, hd_fb_ac, 0, LCD_DDRAM_CELLS, 1 );
+  }
+
+  hd_fb_flushing = 0;
+
+#ifdef LCD_STATS_SUPPORT
+  if( hd_stats.data_bytes - data_before < visible ) LCD_STAT_SKIPPED( visible - ( hd_stats.data_bytes - data_before ) );
+#endif
+  ( void )visible;
+
+  LCD_FlushRestoreCursor();
+}
+
+
+/** Send pending updates for no longer than a time budget.
+  *
+  * Later calls resume where this one stopped.  Fields are never split,
+  * and a field is always sent if nothing else was, so a single field
+  * longer than the budget can overrun it.
+  *
+  * @param max_us: time budget in microseconds
+  * @retval uint8_t: LCD_FLUSH_DONE when the frame is on the glass,
+  *                  LCD_FLUSH_PENDING when more remains
+  */
+uint8_t LCD_FlushBudget( uint32_t max_us )
+{
+  return LCD_FlushSlice( max_us ? max_us : 1, 0 );
+}
+
+
+/** Send at most max_fields pending fields.
+  *
+  * @param max_fields: number of fields to send, at least one
+  * @retval uint8_t: LCD_FLUSH_DONE or LCD_FLUSH_PENDING
+  */
+uint8_t LCD_FlushFields( uint16_t max_fields )
+{
+  return LCD_FlushSlice( 0, max_fields ? max_fields : 1 );
+}
+
+
+#ifdef LCD_SCREEN_SUPPORT
+
+/** Draw a screen template into the frame buffer.
+  *
+  * @param screen: template made with LCD_SCREEN()
+  * @retval none
+  */
+void LCD_ScreenShow( const LCD_Screen * screen )
+{
+  const LCD_Label * label;
+
+  if( screen == NULL ) return;
+
+  hd_screen = screen;
+
+  LCD_FB_Clear();
+
+  for( label = screen->labels; label->text != NULL; label++ )
+  {
+    LCD_FB_Puts( label->x, label->y, label->text );
+  }
+}
+
+
+/** Draw text into a field of the current screen.
+  *
+  * @param id: field number from LCD_SCREEN_FIELD_IDS()
+  * @param text: null-terminated text, NULL for a blank field
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if there is no
+  *                  current screen or no such field
+  */
+uint8_t LCD_ScreenField( uint8_t id, const char * text )
+{
+  const LCD_Field * field;
+  uint8_t           length = 0,
+                    pad    = 0,
+                    col;
+
+  if( hd_screen == NULL || id >= hd_screen->field_count ) return LCD_RESULT_ERROR;
+
+  field = &hd_screen->fields[ id ];
+
+  if( text == NULL ) text = "";
+  while( text[ length ] && length < field->width ) length++;
+
+  if( field->align == LCD_FIELD_RIGHT ) pad = field->width - length;
+
+  for( col = 0; col < field->width; col++ )
+  {
+    LCD_FB_Putc( field->x + col, field->y,
+                 ( col < pad || col - pad >= length ) ? ' ' : ( uint8_t )text[ col - pad ] );
+  }
+
+  return LCD_RESULT_OK;
+}
+
+#endif
+
+
+#ifdef LCD_DOUBLE_BUFFER_SUPPORT
+
+/** Fill all screen buffers with spaces and reset their roles.
+  *
+  * @retval none
+  */
+static void LCD_DB_Reset( void )
+{
+  uint8_t buffer,
+          cell;
+
+  for( cell = 0; cell < LCD_DDRAM_CELLS; cell++ )
+  {
+    hd_db_draw[ cell ] = ' ';
+    for( buffer = 0; buffer < 3; buffer++ ) hd_db_buf[ buffer ][ cell ] = ' ';
+  }
+
+  hd_db_state    = LCD_DB_STATE( 0, 1, 2 );
+  hd_db_swapping = 0;
+}
+
+
+/** Draw one character into the drawing buffer.  Never touches the bus.
+  *
+  * @param x: X coordinate (0 to XMAX)
+  * @param y: Y coordinate (0 to YMAX)
+  * @param ch: character to draw
+  * @retval none
+  */
+void LCD_DB_Putc( uint8_t x, uint8_t y, uint8_t ch )
+{
+  if( x > XMAX || y > YMAX ) return;
+
+  hd_db_draw[ LCD_CellIndex( LCD_DDRAM_Addr( x, y ) ) ] = ch;
+}
+
+
+/** Draw a string into the drawing buffer, clipped at the end of the row.
+  *
+  * @param x: X coordinate of the first character
+  * @param y: Y coordinate
+  * @param string: null-terminated string
+  * @retval none
+  */
+void LCD_DB_Puts( uint8_t x, uint8_t y, const char * string )
+{
+  if( string == NULL || y > YMAX ) return;
+
+  while( *string && x <= XMAX )
+  {
+    hd_db_draw[ LCD_CellIndex( LCD_DDRAM_Addr( x++, y ) ) ] = ( uint8_t )*string++;
+  }
+}
+
+
+/** Fill the drawing buffer with spaces.
+  *
+  * @retval none
+  */
+void LCD_DB_Clear( void )
+{
+  uint8_t cell;
+
+  for( cell = 0; cell < LCD_DDRAM_CELLS; cell++ ) hd_db_draw[ cell ] = ' ';
+}
+
+
+/** Publish what has been drawn.
+  *
+  * The drawing buffer is copied into the back buffer, which only the
+  * swap touches, before the back and ready buffers trade places in one
+  * compare and swap.  The drawing buffer itself is never handed over,
+  * so a write racing the copy lands in this frame or the next.  A swap
+  * that interrupts another only asks it to copy and publish again, so
+  * a half copied buffer is never published.
+  *
+  * @retval none
+  */
+void LCD_Swap( void )
+{
+  uint8_t old_state,
+          new_state,
+          back,
+          cell;
+
+  for( ;; )
+  {
+    old_state = hd_db_swapping;
+    if( old_state == 0 && LCD_ATOMIC_CAS( &hd_db_swapping, 0, 1 ) ) break;
+    if( old_state == 2 || ( old_state == 1 && LCD_ATOMIC_CAS( &hd_db_swapping, 1, 2 ) ) ) return;
+  }
+
+  do
+  {
+    hd_db_swapping = 1;
+
+    back = LCD_DB_BACK( hd_db_state );
+    for( cell = 0; cell < LCD_DDRAM_CELLS; cell++ ) hd_db_buf[ back ][ cell ] = hd_db_draw[ cell ];
+    LCD_MEMORY_BARRIER();
+
+    do
+    {
+      old_state = hd_db_state;
+      new_state = LCD_DB_STATE( LCD_DB_READY( old_state ),
+                                LCD_DB_BACK( old_state ),
+                                LCD_DB_FRONT( old_state ) ) | LCD_DB_FRESH;
+    } while( !LCD_ATOMIC_CAS( &hd_db_state, old_state, new_state ) );
+  } while( !LCD_ATOMIC_CAS( &hd_db_swapping, 1, 0 ) );
+}
+
+
+/** Send the most recently published buffer to the display.
+  *
+  * Call from one consumer only.  The published buffer is handed to the
+  * frame buffer and sent through the flush planner, so only differences
+  * reach the bus.
+  *
+  * @param max_us: time budget as for LCD_FlushBudget(), 0 for no limit
+  * @retval uint8_t: LCD_FLUSH_DONE or LCD_FLUSH_PENDING
+  */
+uint8_t LCD_DB_Service( uint32_t max_us )
+{
+  uint8_t old_state,
+          new_state,
+          cell;
+
+  old_state = hd_db_state;
+
+  if( old_state & LCD_DB_FRESH )
+  {
+    do
+    {
+      old_state = hd_db_state;
+      new_state = LCD_DB_STATE( LCD_DB_BACK( old_state ),
+                                LCD_DB_FRONT( old_state ),
+                                LCD_DB_READY( old_state ) );
+    } while( !LCD_ATOMIC_CAS( &hd_db_state, old_state, new_state ) );
+
+    for( cell = 0; cell < LCD_DDRAM_CELLS; cell++ )
+    {
+      hd_fb_frame[ cell ] = hd_db_buf[ LCD_DB_FRONT( new_state ) ][ cell ];
+    }
+  }
+
+  if( max_us ) return LCD_FlushBudget( max_us );
+
+  LCD_Flush();
+  return LCD_FLUSH_DONE;
+}
+
+#endif
+
+
+#ifdef LCD_QUEUE_SUPPORT
+
+/** Mark every queue slot free.
+  *
+  * @retval none
+  */
+static void LCD_QueueReset( void )
+{
+  uint8_t slot;
+
+  for( slot = 0; slot < LCD_QUEUE_DEPTH; slot++ ) hd_q_slot[ slot ].seq = slot;
+
+  hd_q_head = 0;
+  hd_q_tail = 0;
+}
+
+
+/** Claim the next free queue slot.
+  *
+  * Only retries when another producer claimed the same slot first, so
+  * the time taken is bounded by the number of producers.
+  *
+  * @retval LCD_QueueSlot *: the claimed slot, or NULL if the queue is full
+  */
+static LCD_QueueSlot * LCD_QueueClaim( void )
+{
+  LCD_QueueSlot * slot;
+  uint8_t         pos;
+  int8_t          diff;
+
+  for( ;; )
+  {
+    pos  = hd_q_tail;
+    slot = &hd_q_slot[ pos & ( LCD_QUEUE_DEPTH - 1 ) ];
+    diff = ( int8_t )( uint8_t )( slot->seq - pos );
+
+    if( diff < 0 ) return NULL;
+    if( diff == 0 && LCD_ATOMIC_CAS( &hd_q_tail, pos, ( uint8_t )( pos + 1 ) ) ) break;
+  }
+
+  return slot;
+}
+
+
+/** Hand a filled slot to the consumer.
+  *
+  * @param slot: slot returned by LCD_QueueClaim()
+  * @retval none
+  */
+static void LCD_QueuePublish( LCD_QueueSlot * slot )
+{
+  LCD_MEMORY_BARRIER();
+  slot->seq++;
+}
+
+
+/** Queue a field update: text padded with spaces or clipped to width.
+  *
+  * @param x: X coordinate of the field
+  * @param y: Y coordinate of the field
+  * @param width: field width in characters
+  * @param string: null-terminated string, NULL for a blank field
+  * @retval uint8_t: 1 if queued, 0 if the queue was full
+  */
+uint8_t LCD_PostField( uint8_t x, uint8_t y, uint8_t width, const char * string )
+{
+  LCD_QueueSlot * slot;
+  uint8_t         len;
+
+  if( width > LCD_QUEUE_TEXT_LEN ) width = LCD_QUEUE_TEXT_LEN;
+
+  slot = LCD_QueueClaim();
+  if( slot == NULL ) return 0;
+
+  slot->op  = LCD_OP_TEXT;
+  slot->x   = x;
+  slot->y   = y;
+  slot->len = width;
+
+  for( len = 0; len < width && string != NULL && string[ len ]; len++ )
+  {
+    slot->data[ len ] = ( uint8_t )string[ len ];
+  }
+  for( ; len < width; len++ ) slot->data[ len ] = ' ';
+
+  LCD_QueuePublish( slot );
+  return 1;
+}
+
+
+/** Queue a string to draw at a position.
+  *
+  * @param x: X coordinate of the first character
+  * @param y: Y coordinate
+  * @param string: null-terminated string, clipped to LCD_QUEUE_TEXT_LEN
+  * @retval uint8_t: 1 if queued, 0 if the queue was full
+  */
+uint8_t LCD_Post( uint8_t x, uint8_t y, const char * string )
+{
+  uint8_t len = 0;
+
+  if( string == NULL ) return 0;
+
+  while( len < LCD_QUEUE_TEXT_LEN && string[ len ] ) len++;
+
+  return LCD_PostField( x, y, len, string );
+}
+
+
+#ifdef LCD_UDG_SUPPORT
+
+/** Queue a user-defined character.
+  *
+  * @param ChToSet: character code to define
+  * @param ChDataset: LCD_CGRAM_CHAR_ROWS bytes of pattern data
+  * @retval uint8_t: 1 if queued, 0 if the queue was full
+  */
+uint8_t LCD_PostGlyph( uint8_t ChToSet, const uint8_t * ChDataset )
+{
+  LCD_QueueSlot * slot;
+  uint8_t         row;
+
+  if( ChDataset == NULL || ChToSet >= LCD_CGRAM_CHAR_SLOTS ) return 0;
+
+  slot = LCD_QueueClaim();
+  if( slot == NULL ) return 0;
+
+  slot->op  = LCD_OP_GLYPH;
+  slot->x   = ChToSet;
+  slot->len = LCD_CGRAM_CHAR_ROWS;
+
+  for( row = 0; row < LCD_CGRAM_CHAR_ROWS; row++ ) slot->data[ row ] = ChDataset[ row ];
+
+  LCD_QueuePublish( slot );
+  return 1;
+}
+
+#endif
+
+
+/** Drain the draw queue and send the result to the display.
+  *
+  * Text lands in the frame buffer, so later operations overwrite earlier
+  * ones and only the final cells are sent.  Only the last definition of
+  * each glyph is written.  Call from a single display task.
+  *
+  * @param max_us: time budget as for LCD_FlushBudget(), 0 for no limit
+  * @retval uint8_t: LCD_FLUSH_DONE or LCD_FLUSH_PENDING
+  */
+uint8_t LCD_QueueService( uint32_t max_us )
+{
+  LCD_QueueSlot * slot;
+  uint8_t         index;
+#ifdef LCD_UDG_SUPPORT
+  uint8_t         glyphs[ LCD_CGRAM_CHAR_SLOTS ][ LCD_CGRAM_CHAR_ROWS ];
+  uint8_t         glyph_mask = 0;
+#endif
+
+  for( ;; )
+  {
+    slot = &hd_q_slot[ hd_q_head & ( LCD_QUEUE_DEPTH - 1 ) ];
+    if( slot->seq != ( uint8_t )( hd_q_head + 1 ) ) break;
+
+    LCD_MEMORY_BARRIER();
+
+    if( slot->op == LCD_OP_TEXT )
+    {
+      for( index = 0; index < slot->len; index++ )
+      {
+        LCD_FB_Putc( slot->x + index, slot->y, slot->data[ index ] );
+      }
+    }
+#ifdef LCD_UDG_SUPPORT
+    else if( slot->op == LCD_OP_GLYPH )
+    {
+      for( index = 0; index < LCD_CGRAM_CHAR_ROWS; index++ )
+      {
+        glyphs[ slot->x ][ index ] = slot->data[ index ];
+      }
+      glyph_mask |= 1u << slot->x;
+    }
+#endif
+
+    LCD_MEMORY_BARRIER();
+    slot->seq = ( uint8_t )( hd_q_head + LCD_QUEUE_DEPTH );
+    hd_q_head++;
+  }
+
+#ifdef LCD_UDG_SUPPORT
+  for( index = 0; index < LCD_CGRAM_CHAR_SLOTS; index++ )
+  {
+    if( glyph_mask & ( 1u << index ) ) LCD_Defchar( index, glyphs[ index ] );
+  }
+#endif
+
+  if( max_us ) return LCD_FlushBudget( max_us );
+
+  LCD_Flush();
+  return LCD_FLUSH_DONE;
+}
+
+#endif
+
+
+#ifdef LCD_PRESENT_SUPPORT
+
+/** Enter or leave presentation mode.
+  *
+  * Leaving presentation mode flushes the frame so the display is current.
+  *
+  * @param enable: non-zero to draw into the frame buffer only
+  * @retval none
+  */
+void LCD_PresentMode( uint8_t enable )
+{
+  hd_presenting = enable ? 1 : 0;
+
+  if( !hd_presenting ) LCD_Flush();
+}
+
+
+/** Set the highest rate at which LCD_Present() pushes frames.
+  *
+  * @param hz: frames per second, 0 for no limit
+  * @retval none
+  */
+void LCD_PresentRate( uint8_t hz )
+{
+  hd_present_us = hz ? 1000000UL / hz : 0;
+}
+
+
+/** Push the frame buffer if the frame interval has passed.
+  *
+  * Anything drawn since the last push is coalesced into one frame, so
+  * values overwritten in between never reach the bus.
+  *
+  * @retval uint8_t: 1 if a frame was sent, otherwise 0
+  */
+uint8_t LCD_Present( void )
+{
+  uint32_t now = LCD_Time_us();
+
+  if( now - hd_present_last < hd_present_us ) return 0;
+  if( LCD_FlushCost() == 0 ) return 0;
+
+  hd_present_last = now;
+  LCD_Flush();
+
+  return 1;
+}
+
+#endif
+
+
+/** Return the modelled cost of the next LCD_Flush().
+  *
+  * Compare with LCD_GetStats() or a bus trace to check the model.
+  *
+  * @retval uint32_t: cost in microseconds, 0 if nothing is pending
+  */
+uint32_t LCD_FlushCost( void )
+{
+  uint8_t use_clear;
+
+  return LCD_FlushChoose( &use_clear );
+}
+
+#endif
+
+
+/** Set the cursor state
+  *
+  * @param cursor_state: LCD_CURSOR_OFF, LCD_CURSOR_UNDERLINE,
+  *                      LCD_CURSOR_BLINK, or
+  *                      LCD_CURSOR_UNDERLINE_BLINK.
+  * @retval none
+  */
+void LCD_Cursor( uint8_t cursor_state )
+{
+  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+
+  LCD_Command( 
+              DISP_CTRL | DISP | ( cursor_state & ( CURSOR | BLINK ) )
+             );
+}
+
+
+/** Return the current driver status bitmask.
+  *
+  * @retval uint8_t: LCD_STATUS_* bitmask
+  */
+uint8_t LCD_GetStatus( void )
+{
+  return hd_status;
+}
+
+
+/** Clear the current driver status bitmask.
+  *
+  * @retval none
+  */
+void LCD_ClearStatus( void )
+{
+  hd_status = LCD_STATUS_OK;
+}
+
+
+#ifdef LCD_STATS_SUPPORT
+
+/** Copy the driver statistics.
+  *
+  * @param stats: destination for a snapshot of the counters
+  * @retval none
+  */
+void LCD_GetStats( LCD_Stats * stats )
+{
+  if( stats == NULL ) return;
+
+  *stats = hd_stats;
+}
+
+
+/** Reset the driver statistics.
+  *
+  * @retval none
+  */
+void LCD_ResetStats( void )
+{
+  LCD_Stats zeroed = { 0 };
+
+  hd_stats = zeroed;
+}
+
+#endif
+
+
+#ifdef LCD_TRACE_SUPPORT
+
+/** Pause or resume trace recording.
+  *
+  * @param enable: non-zero to record transactions
+  * @retval none
+  */
+void LCD_TraceEnable( uint8_t enable )
+{
+  hd_trace_on = enable ? 1 : 0;
+}
+
+
+/** Discard all recorded trace entries.
+  *
+  * @retval none
+  */
+void LCD_TraceClear( void )
+{
+  hd_trace_head  = 0;
+  hd_trace_count = 0;
+}
+
+
+/** Remove the oldest trace entries from the ring.
+  *
+  * @param entries: destination for up to max_entries entries, oldest first
+  * @param max_entries: capacity of entries
+  * @retval uint16_t: number of entries copied
+  */
+uint16_t LCD_TraceRead( LCD_TraceEntry * entries, uint16_t max_entries )
+{
+  uint16_t copied = 0;
+
+  if( entries == NULL ) return 0;
+
+  while( hd_trace_count && copied < max_entries )
+  {
+    entries[ copied++ ] = hd_trace[ ( hd_trace_head - hd_trace_count ) & ( LCD_TRACE_DEPTH - 1 ) ];
+    hd_trace_count--;
+  }
+
+  return copied;
+}
+
+
+/** Format a trace entry as one line of the dump format read by
+  * tools/hd_trace2vcd.c, for example "HDT 10432 C W 80 P 0".
+  *
+  * @param entry: trace entry to format
+  * @param buffer: destination for the null-terminated line
+  * @param size: size of buffer
+  * @retval int: characters that would have been written, as snprintf
+  */
+int LCD_TraceFormat( const LCD_TraceEntry * entry, char * buffer, uint16_t size )
+{
+  char phase = 'B';
 
-#endif
+  if( entry == NULL || buffer == NULL ) return -1;
 
-  LCD_Input();
-  LCD_BusyWait();
+  if( entry->flags & LCD_TRACE_NIBBLE_PAIR ) phase = 'P';
+  if( entry->flags & LCD_TRACE_NIBBLE_ONLY ) phase = 'N';
 
+  return snprintf( buffer, size, "HDT %lu %c %c %02X %c %u\n",
+                   ( unsigned long )entry->timestamp,
+                   ( entry->flags & LCD_TRACE_RS )   ? 'D' : 'C',
+                   ( entry->flags & LCD_TRACE_READ ) ? 'R' : 'W',
+                   entry->value,
+                   phase,
+                   entry->polls );
 }
 
+#endif
 
-/** Waits until the LCD is no longer busy
+
+/** Power-up sequence shared by LCD_Init() and LCD_InitAsync().
   *
-  * @param none
-  * @retval none
+  * Each step sends one value and is followed by its delay.
   */
-static inline uint8_t LCD_BusyWait( void )
+#define LCD_INIT_STEP_NIBBLE        0u    // Raw write before the bus width is set
+#define LCD_INIT_STEP_FUNC_SET      1u    // Function set with the configured options
+#define LCD_INIT_STEP_COMMAND       2u    // Ordinary command
+
+typedef struct
 {
-  unsigned long timeout_remaining = LCD_BUSY_WAIT_TIMEOUT;
+  uint8_t kind;
+  uint8_t value;
+  uint8_t delay_ms;
+} LCD_InitStep;
 
-  if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_BUSY_WAIT_FAILED;
+static const LCD_InitStep hd_init_steps[] =
+{
+  /* 4-bit wake-up sequence from HD44780 datasheet: 0x3,0x3,0x3,0x2 on D7..D4. */
+#ifdef LCD_BUS4BIT
+  { LCD_INIT_STEP_NIBBLE,   LCD_INIT_WAKE_NIBBLE,                 LCD_INIT_WAKE_DELAY_MS },
+  { LCD_INIT_STEP_NIBBLE,   LCD_INIT_WAKE_NIBBLE,                 LCD_INIT_STEP_DELAY_MS },
+  { LCD_INIT_STEP_NIBBLE,   LCD_INIT_WAKE_NIBBLE,                 LCD_INIT_STEP_DELAY_MS },
+  { LCD_INIT_STEP_NIBBLE,   LCD_INIT_SET_4BIT_NIBBLE,             LCD_INIT_STEP_DELAY_MS },
+#else
+  { LCD_INIT_STEP_NIBBLE,   FUNC_SET | BUSWIDTH | NUMLINES,       LCD_INIT_WAKE_DELAY_MS },
+  { LCD_INIT_STEP_NIBBLE,   FUNC_SET | BUSWIDTH | NUMLINES,       LCD_INIT_STEP_DELAY_MS },
+#endif
 
-  while( LCD_IsBusy() )
-  {
-#if LCD_BUSY_WAIT_TIMEOUT > 0
-    if( timeout_remaining == 0 )
-    {
-      hd_status |= LCD_STATUS_TIMEOUT;
-      return LCD_BUSY_WAIT_FAILED;
-    }
-    timeout_remaining--;
+#ifdef HD_ISVFD
+  { LCD_INIT_STEP_FUNC_SET, 0,                                    15 },
+  { LCD_INIT_STEP_FUNC_SET, 0,                                    10 },
+  { LCD_INIT_STEP_FUNC_SET, 0,                                    10 },
+#else
+  { LCD_INIT_STEP_FUNC_SET, 0,                                    15 },
+  { LCD_INIT_STEP_FUNC_SET, 0,                                     5 },
+  { LCD_INIT_STEP_FUNC_SET, 0,                                     5 },
 #endif
-  }
 
-  return LCD_BUSY_WAIT_COMPLETE;
-}
+  { LCD_INIT_STEP_COMMAND,  DISP_CTRL | DISP | CURSOR | BLINK,    0 },
+  { LCD_INIT_STEP_COMMAND,  CLR_DISP,                             0 },
+  { LCD_INIT_STEP_COMMAND,  ENT_MODE | INC,                       0 }
+};
 
+#define LCD_INIT_STEPS  ( sizeof( hd_init_steps ) / sizeof( hd_init_steps[ 0 ] ) )
 
-#ifdef LCD_UDG_SUPPORT
 
-/** Define a user-defined character
+/** Reset driver state and put the bus in its idle state.
   *
-  * @param ChToSet: character code to define (0-7)
-  * @param ChDataset: pointer to character data (8 bytes, read-only)
   * @retval none
   */
-void LCD_Defchar( uint16_t ChToSet, const uint8_t * ChDataset )
+static void LCD_InitBegin( void )
 {
-  uint16_t ChAddress,
-      ch_line,
-      defchar_dd_addr;
+  hd_status = LCD_STATUS_OK;
 
-  if( hd_status & LCD_STATUS_TIMEOUT ) return;
-  if( ChDataset == NULL ) return;
-  if( ChToSet >= LCD_CGRAM_CHAR_SLOTS ) return;
-   
-  ChAddress = ChToSet * LCD_CGRAM_CHAR_STRIDE;  // Calculate address to UDG
-  
-  LCD_SetRS( INSTR_REG );
-  LCD_SetRNW( READ );
-  LCD_SetE( ENABLE );
-  defchar_dd_addr = LCD_Input() & 0b1111111;
-  LCD_SetE( DISABLE );
-  delay_cycles( E_CYCLES );
+#ifdef LCD_STATS_SUPPORT
+  LCD_ResetStats();
+#endif
 
-#ifdef LCD_BUS4BIT
+  /*Stops buffering which breaks this driver outright */
+#ifdef __GNUC__
+  setvbuf( stdout, NULL, _IONBF, 0 ); // No Buffering
+#endif
 
-  defchar_dd_addr <<= 4;
-  LCD_SetE( ENABLE );
-  defchar_dd_addr |= LCD_Input() & 0b1111111;
+  /*Initialise the LCD pins */
+  LCD_Input();
   LCD_SetE( DISABLE );
-  delay_cycles( E_CYCLES );
-
-#endif
+  LCD_SetRS( INSTR_REG );
+  LCD_SetRNW( WRITE );
+}
 
-  if( !LCD_BusyWait() ) return;
 
-  LCD_Command(SET_CGRAM_ADD | ChAddress );
-  
-  for( ch_line = 0; ch_line < LCD_CGRAM_CHAR_ROWS; ch_line++ )
+/** Send one step of the power-up sequence.
+  *
+  * @param step: step to send
+  * @retval none
+  */
+static void LCD_InitStepRun( const LCD_InitStep * step )
+{
+  switch( step->kind )
   {
-    LCD_PutData( *ChDataset );
-    ChDataset++;
-  }
+    case LCD_INIT_STEP_NIBBLE:
+      LCD_InitWrite( step->value );
+      break;
 
-  for( ; ch_line < LCD_CGRAM_CHAR_STRIDE; ch_line++ )
-  {
-    LCD_PutData( 0x00 );
+    case LCD_INIT_STEP_FUNC_SET:
+#ifdef HD_ISVFD
+      LCD_Command( FUNC_SET | BUSWIDTH | NUMLINES | LCD_CHAR_FONT_BITS | vfd_intensity );
+#else
+      LCD_Command( FUNC_SET | BUSWIDTH | NUMLINES | LCD_CHAR_FONT_BITS );
+#endif
+      break;
+
+    default:
+      LCD_Command( step->value );
+      break;
   }
-  
-  if( !LCD_BusyWait() ) return;
-  LCD_Command( SET_DDRAM_ADD | defchar_dd_addr );
-  LCD_BusyWait();
 }
 
-#endif
-
 
-/** Move the cursor to the specified coordinates
+/** Reset the software state that depends on a freshly cleared display.
   *
-  * @param x: X coordinate (0 to XMAX)
-  * @param y: Y coordinate (0 to YMAX)
   * @retval none
   */
-void LCD_Locate( uint8_t x, uint8_t y )
+static void LCD_InitFinish( void )
 {
-  if( hd_status & LCD_STATUS_TIMEOUT ) return;
-
-  uint8_t addr = LCD_DDRAM_Addr( x, y );
-  hd_xpos = x; hd_ypos = y;
+  hd_xpos         = 0;
+  hd_ypos         = 0;
   hd_wrap_pending = 0;
-  
-  LCD_Command( SET_DDRAM_ADD | addr );
+
+#ifdef LCD_DOUBLE_BUFFER_SUPPORT
+  LCD_DB_Reset();
+#endif
+#ifdef LCD_QUEUE_SUPPORT
+  LCD_QueueReset();
+#endif
+#ifdef LCD_CANVAS_SUPPORT
+  hd_canvas_known = 0;
+#endif
+#ifdef LCD_WIDGET_SUPPORT
+  hd_widget_set = LCD_WIDGET_SET_NONE;
+#endif
+#ifdef LCD_ANIM_SUPPORT
+  LCD_AnimReset();
+#endif
 }
 
 
-/** Write data to the LCD
+/** Initialize the LCD
   *
-  * @param dat: data byte to write
+  * @brief  Initializes the HD44780 LCD display connected to
+  *         the microcontroller.  This must be called before any
+  *         other LCD functions are used.
+  *
+  * @param none
   * @retval none
   */
-void LCD_PutData( uint8_t dat )
+void LCD_Init(void)
 {
-  if( !LCD_BusyWait() ) return;
-    LCD_SetRS( DATA_REG );
-    LCD_SetRNW( WRITE );
-    delay_cycles( E_CYCLES );
-    LCD_Output( dat );
-    LCD_SetE( ENABLE );
-    delay_cycles( E_CYCLES );
-    LCD_SetE( DISABLE );
-    delay_cycles( E_CYCLES );
+  uint8_t step;
 
-#ifdef LCD_BUS4BIT
-
-    LCD_Output( dat << 4 );
-    LCD_SetE( ENABLE );
-    delay_cycles( E_CYCLES );
-    LCD_SetE( DISABLE );
-    delay_cycles( E_CYCLES );
+  LCD_InitBegin();
 
-#endif
+  /* Wait for more than 15 ms after VCC rises to 4.5V */
+  Delay_ms( LCD_INIT_PWRON_DELAY_MS );
 
-    LCD_Input();
+  for( step = 0; step < LCD_INIT_STEPS; step++ )
+  {
+    LCD_InitStepRun( &hd_init_steps[ step ] );
+    if( hd_init_steps[ step ].delay_ms ) Delay_ms( hd_init_steps[ step ].delay_ms );
+  }
 
+  LCD_InitFinish();
 }
 
 
+#ifdef LCD_INIT_ASYNC_SUPPORT
 
-/** Scroll the display up one line, this is only available if enabled.
+/** Start the power-up sequence without blocking.
+  *
+  * Call LCD_InitPoll() until it returns LCD_INIT_READY.  No other LCD
+  * function may be used until then.
   *
-  * @param none
   * @retval none
   */
-#ifdef LCD_SCROLL_SUPPORT
+void LCD_InitAsync( void )
+{
+  LCD_InitBegin();
 
-void LCD_ScrollUp( void )
+  hd_status     |= LCD_STATUS_INIT_PENDING;
+  hd_init_step   = 0;
+  hd_init_due    = LCD_Time_us() + LCD_INIT_PWRON_DELAY_MS * 1000UL;
+}
+
+
+/** Advance the power-up sequence started by LCD_InitAsync().
+  *
+  * Sends every step whose delay has passed and returns at once
+  * otherwise.  A call blocks only while the controller executes the
+  * commands it sends, at most one CLR_DISP.
+  *
+  * @retval uint8_t: LCD_INIT_READY once done, else LCD_INIT_PENDING
+  */
+uint8_t LCD_InitPoll( void )
 {
-  uint8_t  line_pos,
-        line,
-        ch_moving,
-        new_addr;
+  const LCD_InitStep * step;
 
-  if( hd_status & LCD_STATUS_TIMEOUT ) return;
-  hd_wrap_pending = 0;
+  if( hd_init_step >= LCD_INIT_STEPS ) return LCD_INIT_READY;
+  if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_INIT_PENDING;
 
-/* Don't scroll if there is only one line */
-   if( YMAX == 0 ) return;
+  while( ( int32_t )( LCD_Time_us() - hd_init_due ) >= 0 )
+  {
+    step = &hd_init_steps[ hd_init_step++ ];
+    LCD_InitStepRun( step );
+    hd_init_due = LCD_Time_us() + step->delay_ms * 1000UL;
 
-/* Make a copy one line up */
-  for( line = 1; line <= YMAX; line++)
-    for( line_pos = 0; line_pos <= XMAX; line_pos++ )
+    if( hd_init_step >= LCD_INIT_STEPS )
     {
-      if( !LCD_Readchar( line_pos, line, &ch_moving ) ) return;
-      new_addr = LCD_DDRAM_Addr( line_pos, line - 1 );
-      LCD_Command( SET_DDRAM_ADD | new_addr );
-      LCD_PutData( ch_moving );
+      LCD_InitFinish();
+      hd_status &= ~LCD_STATUS_INIT_PENDING;
+      return LCD_INIT_READY;
     }
-  
-  /* Clear the last line */
-  for(line_pos = 0; line_pos <= XMAX; line_pos++)
-  {
-    LCD_Command(
-                SET_DDRAM_ADD |
-                LCD_DDRAM_Addr( line_pos, YMAX )
-               );
-    LCD_PutData( 0x20 ); 
   }
+
+  return LCD_INIT_PENDING;
 }
+
 #endif
 
 
-/** Get the DDRAM address for the specified coordinates
+#if defined( LCD_RECOVER_SUPPORT ) || defined( LCD_SCRUB_SUPPORT )
+
+/** Read the busy flag and address counter in one go.
   *
-  * @param dd_x: X coordinate (0 to XMAX)
-  * @param dd_y: Y coordinate (0 to YMAX)
-  * @retval uint8_t: DDRAM address for the specified coordinates
+  * @retval uint8_t: busy flag in bit 7, address counter below
   */
-uint8_t LCD_DDRAM_Addr( uint8_t dd_x, uint8_t dd_y )
-{  
-  /* Clamp coordinates to valid range to avoid indexing hd_map out-of-bounds. */
-  if( dd_x > XMAX ) dd_x = XMAX;
-  if( dd_y > YMAX ) dd_y = YMAX;
+static uint8_t LCD_ReadStatus( void )
+{
+  uint8_t status;
 
-  return ( hd_map[ dd_x + ( XMAX + 1 ) * dd_y ] );
+  LCD_SetRS( INSTR_REG );
+  LCD_SetRNW( READ );
+
+  LCD_SetE( ENABLE );
+  delay_cycles( LCD_PULSE_CYCLES );
+  status = LCD_Input();
+  LCD_SetE( DISABLE );
+  delay_cycles( LCD_HOLD_CYCLES );
+
+#ifdef LCD_BUS4BIT
+  LCD_SetE( ENABLE );
+  delay_cycles( LCD_PULSE_CYCLES );
+  status = ( uint8_t )( status << 4 ) | LCD_Input();
+  LCD_SetE( DISABLE );
+  delay_cycles( LCD_HOLD_CYCLES );
+#endif
+
+  LCD_SetRNW( WRITE );
+
+  return status;
 }
 
+#endif
 
 
-#define LCD_Putc( ch_to_put ) LCD_Putchar( ch_to_put );
+#ifdef LCD_RECOVER_SUPPORT
 
-/* Non stdio.h version of putchar 
- * for use with compilers like CCS C
- *
- * @brief Write a character to the LCD
- *
- * @param ch_to_put: character to write
- * @retval none
- */
-uint8_t LCD_Putchar( uint8_t ch )
+#define LCD_RECOVER_ATTEMPTS        3
+#define LCD_RECOVER_PROBE_ADDR      0x15    // Different in each nibble
+
+#ifdef LCD_BUS4BIT
+  #define LCD_RECOVER_BF            0x08    // D7 as returned by LCD_Input()
+#else
+  #define LCD_RECOVER_BF            0x80
+#endif
+
+
+/** Remember the display control and entry mode the application chose.
+  *
+  * @param cmd: instruction just sent
+  * @retval none
+  */
+static void LCD_TrackModes( uint8_t cmd )
 {
-  if( hd_status & LCD_STATUS_TIMEOUT ) return ch;
+  if( ( cmd & 0xF8 ) == DISP_CTRL )
+  {
+    hd_disp_ctrl = cmd;
+  }
+  else if( ( cmd & 0xFC ) == ENT_MODE )
+  {
+    hd_entry_mode = cmd;
+  }
+  else if( cmd == CLR_DISP )
+  {
+    hd_entry_mode |= INC;
+  }
+}
+
+
+/** Wait for the controller with busy flag reads of a given width.
+  *
+  * @param strobes: E pulses per read, 1 while the controller is in
+  *                 8-bit mode, else the bus width's usual count
+  * @retval uint8_t: LCD_RESULT_OK once not busy, LCD_RESULT_ERROR if
+  *                  still busy after the longest instruction time
+  */
+static uint8_t LCD_RecoverWait( uint8_t strobes )
+{
+  uint32_t started = LCD_Time_us();
+  uint8_t  status,
+           strobe;
+
+  LCD_SetRS( INSTR_REG );
+  LCD_SetRNW( READ );
+
+  do
+  {
+    LCD_STAT_POLL();
+    status = 0;
+
+    for( strobe = 0; strobe < strobes; strobe++ )
+    {
+      LCD_SetE( ENABLE );
+      delay_cycles( LCD_PULSE_CYCLES );
+      if( strobe == 0 ) status = LCD_Input();
+      LCD_SetE( DISABLE );
+      delay_cycles( LCD_HOLD_CYCLES );
+    }
+
+    if( !( status & LCD_RECOVER_BF ) ) break;
+  } while( LCD_Time_us() - started < 2 * LCD_BUSY_CLEAR_US );
+
+  LCD_SetRNW( WRITE );
+
+  return ( status & LCD_RECOVER_BF ) ? LCD_RESULT_ERROR : LCD_RESULT_OK;
+}
+
+
+/** Bring the bus back into step with the controller.
+  *
+  * The first wake write may complete a byte that was left half sent, so
+  * the controller is only known to be in 8-bit mode after the third.
+  * Until then each write gets one instruction time, and the busy flag
+  * is read only while the controller is known to be in 8-bit mode.
+  * Success is checked by setting and reading back the address counter.
+  *
+  * @retval uint8_t: LCD_RESULT_OK if the controller answered correctly
+  */
+static uint8_t LCD_Resync( void )
+{
+  LCD_SetRS( INSTR_REG );
+  LCD_SetRNW( WRITE );
+
+#ifdef LCD_BUS4BIT
+  LCD_InitWrite( LCD_INIT_WAKE_NIBBLE );
+  LCD_BusyPause( LCD_BUSY_EXEC_US );
+  LCD_InitWrite( LCD_INIT_WAKE_NIBBLE );
+  LCD_BusyPause( LCD_BUSY_EXEC_US );
+  LCD_InitWrite( LCD_INIT_WAKE_NIBBLE );
+  if( !LCD_RecoverWait( 1 ) ) return LCD_RESULT_ERROR;
+
+  /* BF cannot be read until this function set has run, and single
+     strobes would leave the nibble phase odd, so wait it out. */
+  LCD_InitWrite( LCD_INIT_SET_4BIT_NIBBLE );
+  LCD_BusyPause( LCD_BUSY_EXEC_US );
+#else
+  LCD_InitWrite( FUNC_SET | BUSWIDTH | NUMLINES );
+  if( !LCD_RecoverWait( 1 ) ) return LCD_RESULT_ERROR;
+#endif
+
+  LCD_Command( SET_DDRAM_ADD | LCD_RECOVER_PROBE_ADDR );
+
+  return ( LCD_ReadStatus() == LCD_RECOVER_PROBE_ADDR ) ? LCD_RESULT_OK : LCD_RESULT_ERROR;
+}
 
-  if( hd_wrap_pending )
-  {
-    hd_wrap_pending = 0;
 
-    if( ch == '\r' )
-    {
-      hd_xpos = 0;
-    }
-    else if( ch == '\n' )
-    {
-      hd_ypos++;
-#ifdef HD_NL_DOES_CR
-      hd_xpos = 0;
+/** Recover from a bus upset without a full LCD_Init().
+  *
+  * Re-synchronises the bus, then restores the function set, display
+  * control, entry mode, custom characters and, with the frame buffer,
+  * the screen contents from what the driver remembers.  Nothing is
+  * cleared, so the display never goes blank.
+  *
+  * @retval uint8_t: LCD_RESULT_OK on success, LCD_RESULT_ERROR if the
+  *                  controller did not answer
+  */
+uint8_t LCD_Recover( void )
+{
+  static const LCD_InitStep func_set = { LCD_INIT_STEP_FUNC_SET, 0, 0 };
+  uint8_t attempt,
+          entry_mode = hd_entry_mode;
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  uint8_t cell;
 #endif
 
-      if( hd_ypos > YMAX )
-#ifdef LCD_SCROLL_SUPPORT
-      {
-        LCD_ScrollUp();
-        hd_ypos = YMAX;
-      }
-#else // The alternative is to wrap around and overwrite. Meh!
-      {
-        hd_xpos=0;
-        hd_ypos=0;
-      }
-#endif
+  for( attempt = 0; attempt < LCD_RECOVER_ATTEMPTS; attempt++ )
+  {
+    hd_status &= ~LCD_STATUS_TIMEOUT;
+    if( LCD_Resync() && !( hd_status & LCD_STATUS_TIMEOUT ) ) break;
 
-      LCD_Command( SET_DDRAM_ADD | LCD_DDRAM_Addr( hd_xpos, hd_ypos ) );
-      return ch;
-    }
-    else
-    {
-      hd_xpos = 0;
-      hd_ypos++;
+    /* A garbled write may have started a clear, which ignores the bus. */
+    LCD_RecoverWait( 1 );
+  }
 
-      if( hd_ypos > YMAX )
-#ifdef LCD_SCROLL_SUPPORT
-      {
-        hd_ypos = YMAX;
-        LCD_ScrollUp();
-      }
-#else   // The alternative is to wrap around and overwrite. Meh!
-      {
-        hd_ypos = 0;
-      }
-#endif
-    }
+  if( attempt == LCD_RECOVER_ATTEMPTS )
+  {
+    hd_status |= LCD_STATUS_TIMEOUT;
+    return LCD_RESULT_ERROR;
   }
-     
-  dd_addr = LCD_DDRAM_Addr( hd_xpos, hd_ypos );
-  
-  switch( ch )
+
+  LCD_InitStepRun( &func_set );
+  LCD_Command( hd_disp_ctrl );
+
+#ifdef LCD_UDG_SUPPORT
+  for( attempt = 0; attempt < LCD_CGRAM_CHAR_SLOTS; attempt++ )
   {
-    case '\n':
-      hd_ypos++;
-#ifdef HD_NL_DOES_CR
-      hd_xpos = 0;
-#endif
-      if( hd_ypos > YMAX )
-#ifdef LCD_SCROLL_SUPPORT
-      {
-        LCD_ScrollUp();
-        hd_ypos = YMAX;
-      }
-#else // The alternative is to wrap around and overwrite. Meh!
-      {
-        hd_xpos=0;
-        hd_ypos=0;
-      }
+    if( hd_cgram_valid & ( 1u << attempt ) ) LCD_Defchar( attempt, hd_cgram_shadow[ attempt ] );
+  }
 #endif
-      LCD_Command( SET_DDRAM_ADD | LCD_DDRAM_Addr( hd_xpos, hd_ypos ) );
-      break;
 
-    case '\r':
-      {
-        hd_xpos = 0;
-        hd_wrap_pending = 0;
-        LCD_Command( SET_DDRAM_ADD | LCD_DDRAM_Addr( hd_xpos, hd_ypos ) );
-        break;
-      }
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  for( cell = 0; cell < sizeof( hd_fb_stale ); cell++ ) hd_fb_stale[ cell ] = 0xFF;
 
-    default:
-      LCD_Command( SET_DDRAM_ADD | dd_addr );
-      LCD_PutData( ch );
-      if( hd_xpos < XMAX )
-      {
-        hd_xpos++;
-      }
-      else
-      {
-        hd_wrap_pending = 1;
-      }
+  hd_fb_flushing = 1;
+  LCD_Command( ENT_MODE | INC );
+  LCD_FlushPlan( hd_fb_glass, hd_fb_ac, 0, LCD_DDRAM_CELLS, 1 );
+  hd_fb_flushing = 0;
+#endif
 
-    LCD_Command( SET_DDRAM_ADD | LCD_DDRAM_Addr( hd_xpos, hd_ypos ) );
-  }
-  return ch;
+  LCD_Command( entry_mode );
+  LCD_Command( SET_DDRAM_ADD | LCD_DDRAM_Addr( hd_xpos, hd_ypos ) );
+
+  return ( hd_status & LCD_STATUS_TIMEOUT ) ? LCD_RESULT_ERROR : LCD_RESULT_OK;
 }
 
-/** Write a null-terminated string to the LCD.
+#endif
+
+
+#ifdef LCD_TUNE_SUPPORT
+
+/** Write test patterns and read them back at the timing in use.
   *
-  * @param string: string to write
-  * @retval none
+  * Every round shifts the patterns along the cells.  On a failure the
+  * safe timing is put back and the controller recovered.
+  *
+  * @param safe: timing known to work
+  * @retval uint8_t: LCD_RESULT_OK if every byte read back correctly
   */
-void LCD_Puts( const char * string )
+static uint8_t LCD_TuneTrial( const LCD_Timing * safe )
 {
-  if( string == NULL ) return;
+  static const uint8_t patterns[] = { 0x55, 0xAA, 0x00, 0xFF };
+  uint8_t round,
+          cell,
+          got;
 
-  while( *string )
+  for( round = 0; round < LCD_TUNE_ROUNDS; round++ )
   {
-    LCD_Putchar( ( uint8_t )*string );
-    string++;
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+    hd_fb_flushing = 1;
+#endif
+    LCD_Command( SET_DDRAM_ADD | LCD_TUNE_ADDR );
+    for( cell = 0; cell < LCD_TUNE_CELLS; cell++ ) LCD_PutData( patterns[ ( round + cell ) & 3 ] ^ ( 1u << cell ) );
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+    hd_fb_flushing = 0;
+#endif
+
+    for( cell = 0; cell < LCD_TUNE_CELLS; cell++ )
+    {
+      if( LCD_Read_DDRAM( LCD_TUNE_ADDR + cell, &got ) != LCD_RESULT_OK
+          || got != ( patterns[ ( round + cell ) & 3 ] ^ ( 1u << cell ) ) )
+      {
+        hd_timing = *safe;
+        LCD_Recover();
+        return LCD_RESULT_ERROR;
+      }
+    }
   }
+
+  return LCD_RESULT_OK;
 }
 
-#ifdef LCD_PRINTF_SUPPORT
-/** Format a string and write it to the LCD.
+
+/** Find the fastest bus timing that reads back correctly, then add the
+  * safety margin.
   *
-  * Output is truncated to LCD_PRINTF_BUFFER_SIZE - 1 characters.
+  * Each delay is stepped down on its own, the others held at their
+  * starting values, until a trial fails.  The margined result is then
+  * checked as a whole and backed off a cycle at a time if it fails.
   *
-  * @param format: printf-style format string
-  * @retval int: number of characters that would have been written,
-  *              or a negative value on formatting error.
+  * @param timing: receives the timing now in use, may be NULL
+  * @retval uint8_t: LCD_RESULT_OK, or LCD_RESULT_ERROR if the starting
+  *                  timing fails or the controller cannot be recovered
   */
-int LCD_Printf( const char * format, ... )
+uint8_t LCD_Tune( LCD_Timing * timing )
 {
-  char buffer[ LCD_PRINTF_BUFFER_SIZE ];
-  va_list args;
-  int chars_formatted;
+  const LCD_Timing safe = hd_timing;
+  LCD_Timing       tuned;
+  uint8_t * const  delay[] = { &hd_timing.setup, &hd_timing.pulse, &hd_timing.hold };
+  uint8_t * const  limit[] = { &tuned.setup, &tuned.pulse, &tuned.hold };
+  uint16_t         margined;
+  uint8_t          saved[ LCD_TUNE_CELLS ],
+                   index,
+                   cell,
+                   value,
+                   backed;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_RESULT_ERROR;
+
+  for( cell = 0; cell < LCD_TUNE_CELLS; cell++ )
+  {
+    if( LCD_Read_DDRAM( LCD_TUNE_ADDR + cell, &saved[ cell ] ) != LCD_RESULT_OK ) return LCD_RESULT_ERROR;
+  }
 
-  if( format == NULL ) return -1;
+  if( LCD_TuneTrial( &safe ) != LCD_RESULT_OK ) return LCD_RESULT_ERROR;
 
-  va_start( args, format );
-  chars_formatted = vsnprintf( buffer, sizeof( buffer ), format, args );
-  va_end( args );
+  for( index = 0; index < 3; index++ )
+  {
+    for( value = *delay[ index ]; value > 0; value-- )
+    {
+      *delay[ index ] = value - 1;
+      if( LCD_TuneTrial( &safe ) != LCD_RESULT_OK ) break;
+    }
 
-  if( chars_formatted < 0 ) return chars_formatted;
+    hd_timing = safe;
+    if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_RESULT_ERROR;
 
-  LCD_Puts( buffer );
-  return chars_formatted;
-}
-#endif
+    margined        = value + ( value * LCD_TUNE_MARGIN_PERCENT + 99u ) / 100u;
+    *limit[ index ] = ( margined < *delay[ index ] ) ? ( uint8_t )margined : *delay[ index ];
+  }
 
-/* CrossWorks ARM printf support */
-#ifdef __CROSSWORKS_ARM
-int __putchar(int ch, __printf_tag_ptr ptr)
-{
-  return LCD_Putchar( ch );
-}
+  do
+  {
+    hd_timing = tuned;
+    if( LCD_TuneTrial( &safe ) == LCD_RESULT_OK ) break;
+    if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_RESULT_ERROR;
+
+    backed = 0;
+    for( index = 0; index < 3; index++ )
+    {
+      if( *limit[ index ] < *delay[ index ] )
+      {
+        ( *limit[ index ] )++;
+        backed = 1;
+      }
+    }
+  } while( backed );
+
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  hd_fb_flushing = 1;
 #endif
+  LCD_Command( SET_DDRAM_ADD | LCD_TUNE_ADDR );
+  for( cell = 0; cell < LCD_TUNE_CELLS; cell++ ) LCD_PutData( saved[ cell ] );
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+  hd_fb_flushing = 0;
+#endif
+  LCD_SyncCursor();
 
-/* GNU putchar support. (Some might prefer _write instead) */
-#if defined(__GNUC__) && !defined(__CROSSWORKS_ARM)
+  LCD_GetTiming( timing );
 
-PUTCHAR_PROTOTYPE
-{
-  LCD_Putchar( ch );
-  return ch;
+  return ( hd_status & LCD_STATUS_TIMEOUT ) ? LCD_RESULT_ERROR : LCD_RESULT_OK;
 }
-#endif
 
 
-/** Clear the LCD display
+/** Read the bus timing in use.
   *
-  * @param none
+  * @param timing: receives the timing, may be NULL
   * @retval none
   */
-void LCD_Clear(void)
+void LCD_GetTiming( LCD_Timing * timing )
 {
-  if( !LCD_BusyWait() ) return;
-  LCD_Command(CLR_DISP);
-  if( !LCD_BusyWait() ) return;
-  hd_wrap_pending = 0;
-  LCD_Locate( 0, 0 );
+  if( timing != NULL ) *timing = hd_timing;
 }
 
 
-/** Set the cursor state
+/** Use a stored bus timing.
   *
-  * @param cursor_state: LCD_CURSOR_OFF, LCD_CURSOR_UNDERLINE,
-  *                      LCD_CURSOR_BLINK, or
-  *                      LCD_CURSOR_UNDERLINE_BLINK.
+  * @param timing: timing from LCD_GetTiming(), or NULL for E_CYCLES
   * @retval none
   */
-void LCD_Cursor( uint8_t cursor_state )
+void LCD_SetTiming( const LCD_Timing * timing )
 {
-  if( hd_status & LCD_STATUS_TIMEOUT ) return;
+  static const LCD_Timing fixed = { E_CYCLES, E_CYCLES, E_CYCLES };
 
-  LCD_Command( 
-              DISP_CTRL | DISP | ( cursor_state & ( CURSOR | BLINK ) )
-             );
+  hd_timing = ( timing != NULL ) ? *timing : fixed;
 }
 
+#endif
 
-/** Return the current driver status bitmask.
-  *
-  * @retval uint8_t: LCD_STATUS_* bitmask
-  */
-uint8_t LCD_GetStatus( void )
-{
-  return hd_status;
-}
 
+#ifdef LCD_SCRUB_SUPPORT
 
-/** Clear the current driver status bitmask.
+#if !defined( LCD_FRAMEBUFFER_SUPPORT ) || !defined( LCD_READ_DD_SUPPORT )
+  #error LCD_SCRUB_SUPPORT needs LCD_FRAMEBUFFER_SUPPORT and LCD_READ_DD_SUPPORT.
+#endif
+
+#define LCD_SCRUB_CELLS             ( ( XMAX + 1 ) * ( YMAX + 1 ) )
+
+static          uint8_t   hd_scrub_pos    = 0;
+
+
+/** Decide whether a bad read points at lost nibble sync.
   *
-  * @retval none
+  * @param expected: what the glass record holds
+  * @param got: what was read back
+  * @retval uint8_t: 1 if got is expected with its nibbles swapped
   */
-void LCD_ClearStatus( void )
+static uint8_t LCD_ScrubSwapped( uint8_t expected, uint8_t got )
 {
-  hd_status = LCD_STATUS_OK;
+  uint8_t swapped = ( uint8_t )( ( expected << 4 ) | ( expected >> 4 ) );
+
+  return swapped != expected && got == swapped;
 }
 
 
-/** Initialize the LCD
+/** Check a few visible cells against the glass record and repair them.
   *
-  * @brief  Initializes the HD44780 LCD display connected to
-  *         the microcontroller.  This must be called before any
-  *         other LCD functions are used.
+  * Carries on from where the previous call stopped, so calling this
+  * from the main loop checks the whole screen every
+  * LCD_SCRUB_CELLS / max_cells calls.  Cells that read back wrong are
+  * rewritten.  A failed read, a byte with its nibbles swapped, an
+  * address counter that is not where the driver left it, or
+  * LCD_SCRUB_RESYNC_LIMIT bad cells in one call mean the bus has lost
+  * sync, and the whole controller is then recovered.
   *
-  * @param none
-  * @retval none
+  * @param max_cells: number of cells to check in this call
+  * @retval uint8_t: LCD_SCRUB_CLEAN, LCD_SCRUB_REPAIRED,
+  *                  LCD_SCRUB_RESYNCED or LCD_SCRUB_FAILED
   */
-void LCD_Init(void)
+uint8_t LCD_Scrub( uint8_t max_cells )
 {
-  hd_status = LCD_STATUS_OK;
-
-  /*Stops buffering which breaks this driver outright */
-#ifdef __GNUC__
-  setvbuf( stdout, NULL, _IONBF, 0 ); // No Buffering
+  uint8_t addr,
+          cell,
+          expected,
+          got,
+          bad    = 0,
+          result = LCD_SCRUB_CLEAN;
+
+  if( hd_status & LCD_STATUS_TIMEOUT ) return LCD_SCRUB_FAILED;
+#ifdef LCD_PRESENT_SUPPORT
+  if( hd_presenting ) return LCD_SCRUB_CLEAN;
 #endif
 
-  /*Initialise the LCD pins */
-  LCD_Input();
-  LCD_SetE( DISABLE );
-  LCD_SetRS( INSTR_REG );
-  LCD_SetRNW( WRITE );
+  hd_fb_flushing = 1;
 
-  /* Wait for more than 15 ms after VCC rises to 4.5V */
-  Delay_ms( LCD_INIT_PWRON_DELAY_MS );
+  while( max_cells-- )
+  {
+    addr     = LCD_DDRAM_Addr( hd_scrub_pos % ( XMAX + 1 ), hd_scrub_pos / ( XMAX + 1 ) );
+    cell     = LCD_CellIndex( addr );
+    expected = hd_fb_glass[ cell ];
 
-  /* 4-bit wake-up sequence from HD44780 datasheet: 0x3,0x3,0x3,0x2 on D7..D4. */
-#ifdef LCD_BUS4BIT
-  LCD_OutputUpperNibble( LCD_INIT_WAKE_NIBBLE );
-  LCD_SetE( ENABLE );
-  LCD_SetE( DISABLE );
-  Delay_ms( LCD_INIT_WAKE_DELAY_MS );
+    if( ++hd_scrub_pos >= LCD_SCRUB_CELLS ) hd_scrub_pos = 0;
+    if( LCD_GLASS_STALE( cell ) ) continue;
 
-  LCD_OutputUpperNibble( LCD_INIT_WAKE_NIBBLE );
-  LCD_SetE( ENABLE );
-  LCD_SetE( DISABLE );
-  Delay_ms( LCD_INIT_STEP_DELAY_MS );
+    if( !LCD_Read_DDRAM( addr, &got ) || LCD_ScrubSwapped( expected, got ) )
+    {
+      bad = LCD_SCRUB_RESYNC_LIMIT;
+      break;
+    }
 
-  LCD_OutputUpperNibble( LCD_INIT_WAKE_NIBBLE );
-  LCD_SetE( ENABLE );
-  LCD_SetE( DISABLE );
-  Delay_ms( LCD_INIT_STEP_DELAY_MS );
+    if( got != expected )
+    {
+      LCD_Command( SET_DDRAM_ADD | addr );
+      LCD_PutData( expected );
+      result = LCD_SCRUB_REPAIRED;
+      if( ++bad >= LCD_SCRUB_RESYNC_LIMIT ) break;
+    }
+  }
 
-  LCD_OutputUpperNibble( LCD_INIT_SET_4BIT_NIBBLE );
-  LCD_SetE( ENABLE );
-  LCD_SetE( DISABLE );
-  Delay_ms( LCD_INIT_STEP_DELAY_MS );
-#else
-  LCD_Output( FUNC_SET | BUSWIDTH | NUMLINES );
-  LCD_SetE( ENABLE );
-  LCD_SetE( DISABLE );
-  Delay_ms( LCD_INIT_WAKE_DELAY_MS );
+  hd_fb_flushing = 0;
 
-  LCD_Output( FUNC_SET | BUSWIDTH | NUMLINES );
-  LCD_SetE( ENABLE );
-  LCD_SetE( DISABLE );
-  Delay_ms( LCD_INIT_STEP_DELAY_MS );
+  /* The last read or repair may still be running with BF set. */
+  if( hd_fb_ac != LCD_CELL_UNKNOWN && bad < LCD_SCRUB_RESYNC_LIMIT &&
+      ( !LCD_BusyWait() || ( LCD_ReadStatus() & 0x7F ) != LCD_CellAddr( hd_fb_ac ) ) )
+  {
+    bad = LCD_SCRUB_RESYNC_LIMIT;
+  }
+
+  if( bad >= LCD_SCRUB_RESYNC_LIMIT )
+  {
+#ifdef LCD_RECOVER_SUPPORT
+    return LCD_Recover() ? LCD_SCRUB_RESYNCED : LCD_SCRUB_FAILED;
+#else
+    return LCD_SCRUB_FAILED;
 #endif
+  }
 
-#ifdef HD_ISVFD
+  LCD_FlushRestoreCursor();
 
-  LCD_Command( FUNC_SET | BUSWIDTH | NUMLINES | LCD_CHAR_FONT_BITS | vfd_intensity );
-  Delay_ms( 15 );
-  LCD_Command( FUNC_SET | BUSWIDTH | NUMLINES | LCD_CHAR_FONT_BITS | vfd_intensity );
-  Delay_ms( 10 );
-  LCD_Command( FUNC_SET | BUSWIDTH | NUMLINES | LCD_CHAR_FONT_BITS | vfd_intensity );
-  Delay_ms( 10 );
-   
-#else  
-  
-  LCD_Command( FUNC_SET | BUSWIDTH | NUMLINES | LCD_CHAR_FONT_BITS );
-  Delay_ms( 15 );
-  LCD_Command( FUNC_SET | BUSWIDTH | NUMLINES | LCD_CHAR_FONT_BITS );
-  Delay_ms( 5 );
-  LCD_Command( FUNC_SET | BUSWIDTH | NUMLINES | LCD_CHAR_FONT_BITS );
-  Delay_ms( 5 );
+  return result;
+}
 
 #endif
-  
-  LCD_Command(DISP_CTRL | DISP | CURSOR | BLINK);
-  LCD_BusyWait();
-  LCD_Command(CLR_DISP);
-  LCD_BusyWait();
-  hd_wrap_pending = 0;
-  LCD_Command(ENT_MODE | INC);
-}
 
 
 // Vacuum Flourescent Display intensity control.
@@ -104,7 +104,8 @@
 
 /** LCD Timing
   * 
-  * This sets the number of cycles hold time for the bus.
+  * This sets the number of cycles hold time for the bus.  With
+  * LCD_TUNE_SUPPORT it is only the starting point for LCD_Tune().
  */
 #define E_CYCLES      8 // How many cycles to delay for bus settling and controller response.
 
@@ -148,6 +149,45 @@
   */
   //#define HD_NL_DOES_CR
 
+/** Text viewports with their own cursor, wrap and scroll.
+  *
+  */
+  //#define LCD_VIEWPORT_SUPPORT
+
+/** Non-blocking power-up with LCD_InitAsync() and LCD_InitPoll().
+  *
+  * Needs LCD_Time_us() for your platform.
+  */
+  //#define LCD_INIT_ASYNC_SUPPORT
+
+/** Fast recovery with LCD_Recover() after a timeout or bus upset.
+  *
+  * Keeps a copy of the display modes and custom characters, 64 bytes
+  * for 5x8 fonts.  Screen contents are restored too when
+  * LCD_FRAMEBUFFER_SUPPORT is defined.  Needs LCD_Time_us().
+  */
+  //#define LCD_RECOVER_SUPPORT
+
+/** Background DDRAM scrub with LCD_Scrub().
+  *
+  * Reads cells back and repairs any that differ from the frame buffer's
+  * record of the glass.  Needs LCD_FRAMEBUFFER_SUPPORT and, unless in
+  * Lite mode, uses LCD_Recover() when the bus has lost sync.
+  */
+  //#define LCD_SCRUB_SUPPORT
+  #define LCD_SCRUB_RESYNC_LIMIT    3     // Bad cells per call that mean lost sync
+
+/** Bus timing auto-tuner with LCD_Tune().
+  *
+  * Replaces E_CYCLES with setup, pulse and hold delays set at run time,
+  * found by stepping each down until read-back errors begin.  Needs
+  * LCD_RECOVER_SUPPORT and LCD_READ_DD_SUPPORT.
+  */
+  //#define LCD_TUNE_SUPPORT
+  #define LCD_TUNE_MARGIN_PERCENT   50    // Added to the fastest passing values
+  #define LCD_TUNE_ROUNDS           4     // Pattern passes per trial
+  #define LCD_TUNE_ADDR             0x00  // First of the 8 DDRAM cells used
+
 /** Character font selection.
   *
   * 5x10 mode is intended for supported one-line modules.
@@ -156,6 +196,112 @@
   #define LCD_CHAR_FONT_5X10   1u
   #define LCD_CHAR_FONT        LCD_CHAR_FONT_5X8
 
+/** UTF-8 text output.
+  *
+  * LCD_Putchar() and everything built on it decode UTF-8 and translate
+  * it to the character ROM selected by LCD_CHAR_ROM.  Characters the ROM
+  * lacks show as LCD_UTF8_REPLACEMENT, or with LCD_UTF8_CGRAM_FALLBACK
+  * as glyphs registered with LCD_UTF8_AddGlyph(), loaded into the top
+  * LCD_UTF8_CGRAM_SLOTS CGRAM slots on demand.
+  */
+  #define LCD_ROM_A00          0u     // Japanese standard font
+  #define LCD_ROM_A02          1u     // European font
+  #define LCD_CHAR_ROM         LCD_ROM_A00
+
+  //#define LCD_UTF8_SUPPORT
+  #define LCD_UTF8_REPLACEMENT '?'
+  //#define LCD_UTF8_CGRAM_FALLBACK
+  #define LCD_UTF8_CGRAM_SLOTS 2
+  #define LCD_UTF8_GLYPHS      8      // Registered fallback glyphs
+
+/** Marquee scrolling with the controller's display shift.
+  *
+  * Needs LCD_Time_us() for your platform.
+  */
+  //#define LCD_MARQUEE_SUPPORT
+
+/** Off-screen pages on panels narrower than their DDRAM lines.
+  *
+  * 8, 16 and 20 column one and two row panels, split 16x1 and 24x1
+  * panels and the linear 16x1 have room for extra screens.  Not the
+  * linear 24x1 or 4-row panels.
+  */
+  //#define LCD_PAGE_SUPPORT
+
+/** Pixel canvas drawn into CGRAM.
+  *
+  * LCD_CANVAS_COLS by LCD_CANVAS_ROWS character cells, using the CGRAM
+  * slots from LCD_CANVAS_FIRST up; at most 8 cells for 5x8 fonts and 4
+  * for 5x10.  Needs LCD_UDG_SUPPORT.
+  */
+  //#define LCD_CANVAS_SUPPORT
+  #define LCD_CANVAS_COLS      4
+  #define LCD_CANVAS_ROWS      2
+  #define LCD_CANVAS_FIRST     0
+
+/** VT100 terminal input with LCD_VT100_Write() or the receive ring.
+  *
+  * LCD_VT100_RX_SIZE bytes of ring hold a burst while the display
+  * catches up; at 115200 baud a byte arrives every 87 us.
+  */
+  //#define LCD_VT100_SUPPORT
+  #define LCD_VT100_RX_SIZE    128    // Must be a power of two
+
+/** Right-aligned numbers with LCD_PutNumberRight(), written backwards
+  * with the entry mode set to decrement.
+  */
+  //#define LCD_RIGHT_ALIGN_SUPPORT
+
+/** Scrollback console with LCD_ConsolePutc() and LCD_ConsoleScroll().
+  *
+  * Keeps the last LCD_CONSOLE_LINES lines in RAM, one panel row each.
+  */
+  //#define LCD_CONSOLE_SUPPORT
+  #define LCD_CONSOLE_LINES    16
+
+/** Screen templates of fixed labels and numbered fields.
+  *
+  * Needs LCD_FRAMEBUFFER_SUPPORT.
+  */
+  //#define LCD_SCREEN_SUPPORT
+
+/** Packed glyph sets, 5 bits per row, loaded with LCD_LoadGlyphPack().
+  *
+  * Needs LCD_UDG_SUPPORT.
+  */
+  //#define LCD_GLYPH_PACK_SUPPORT
+
+/** CGRAM animation with LCD_AnimStart() and LCD_AnimTick().
+  *
+  * Up to LCD_ANIM_MAX custom characters animate at once, each through
+  * up to LCD_ANIM_FRAMES frames.  Needs LCD_UDG_SUPPORT and LCD_Time_us().
+  */
+  //#define LCD_ANIM_SUPPORT
+  #define LCD_ANIM_MAX         4
+  #define LCD_ANIM_FRAMES      8
+
+/** Bar graph and big digit widgets.
+  *
+  * Bars and big digits each load their own custom characters into CGRAM
+  * when first drawn, so use one kind per screen and no LCD_Defchar()
+  * alongside.  Needs LCD_UDG_SUPPORT and the 5x8 font.
+  */
+  //#define LCD_WIDGET_SUPPORT
+  #define LCD_WIDGET_BLOCK     0xFF   // ROM code of a solid block
+  #define LCD_BIGNUM_DIGITS    5      // Most digits in one LCD_BigNum
+
+/** DMA waveform engine.
+  *
+  * LCD_WaveCommand() and LCD_WaveData() compile bus writes into GPIO
+  * BSRR words, one per LCD_WAVE_TICK_NS timer tick, with the E strobes
+  * and instruction times built in.  LCD_WaveStart() plays them with a
+  * timer-paced DMA channel, see LCD_WAVE_TIM in hw_interface_stm32.h.
+  * All bus pins must be on one GPIO port.
+  */
+  //#define LCD_WAVE_SUPPORT
+  #define LCD_WAVE_WORDS       512    // 4 bytes each
+  #define LCD_WAVE_TICK_NS     4000   // Timer period, at least 250
+
 /** Do you want scrolling or wrap to beginning?
   *
   */
@@ -180,6 +326,111 @@
   */
   #define LCD_BUSY_WAIT_TIMEOUT 100000UL
 
+/** Adaptive busy waiting.
+  *
+  * The driver remembers when the last transfer ended and how long it
+  * takes, from the LCD_BUSY_*_US times below.  Busy waits skip polling
+  * once the worst case has passed, and otherwise spin through most of
+  * the typical time, then poll with a doubling gap.  Commands return
+  * without waiting, so that wait falls on the next transfer.  Needs
+  * LCD_Time_us().
+  */
+  //#define LCD_BUSY_ADAPTIVE_SUPPORT
+  #define LCD_BUSY_WORST_PERCENT    150   // Worst case, allows for a slow oscillator
+  #define LCD_BUSY_EARLY_PERCENT    80    // Share of the typical time before polling
+  #define LCD_BUSY_BACKOFF_MAX_US   32    // Largest gap between polls
+
+/** Controller execution times, in microseconds.
+  *
+  * What the driver allows each transfer when it does not read the busy
+  * flag: adaptive busy waits, DMA waveforms and recovery.  These are the
+  * datasheet times and, unlike the LCD_COST_*_US planner weights, must
+  * not be set below what your controller needs.
+  */
+  #define LCD_BUSY_EXEC_US          37    // Most instructions
+  #define LCD_BUSY_DATA_US          41    // Data write or read, 37 us + tADD
+  #define LCD_BUSY_CLEAR_US       1520    // CLR_DISP and RET_HOME
+
+/** Driver statistics returned by LCD_GetStats().
+  *
+  * Comment out LCD_STATS_SUPPORT to remove them entirely, or comment
+  * out any of the LCD_STATS_* lines below to drop just that counter.
+  * The blocked time counter needs LCD_Time_us() for your platform.
+  */
+  #define LCD_STATS_SUPPORT
+  #define LCD_STATS_COMMANDS        // Instruction register writes
+  #define LCD_STATS_DATA            // Data register writes
+  #define LCD_STATS_STROBES         // E pulses, reads included
+  #define LCD_STATS_POLLS           // Busy flag reads
+  #define LCD_STATS_RECONFIG        // Data bus direction changes
+  #define LCD_STATS_SKIPPED         // Bytes not sent thanks to optimisations
+  #define LCD_STATS_TIMEOUTS        // Busy waits that timed out
+  #define LCD_STATS_BUSY_HIST       // Max and histogram of polls per busy wait
+  #define LCD_STATS_BLOCKED_TIME    // Microseconds spent in busy waits
+  #define LCD_STATS_HIST_BUCKETS    8
+
+/** Bus transaction trace recorder.
+  *
+  * Keeps the last LCD_TRACE_DEPTH bus transactions in RAM, 8 bytes each.
+  * Dump them with LCD_TraceRead() and LCD_TraceFormat(), then convert
+  * the dump with tools/hd_trace2vcd.c.  Needs LCD_Time_us().
+  */
+  //#define LCD_TRACE_SUPPORT
+  #define LCD_TRACE_DEPTH           64    // Must be a power of two
+
+/** Frame buffer with change tracking for LCD_Flush().
+  *
+  * The driver keeps a copy of all 80 DDRAM cells as it believes they
+  * are on the glass, plus a target frame drawn with the LCD_FB_*
+  * functions.  LCD_Flush() then sends only what differs.  Costs 160
+  * bytes of RAM.
+  */
+  //#define LCD_FRAMEBUFFER_SUPPORT
+
+/** Flush planner cost model, in microseconds.
+  *
+  * LCD_COST_XFER_US is the time the driver takes to clock one byte and
+  * poll the busy flag on your transport; the others are the controller
+  * execution times from the datasheet.  Tune these to your hardware.
+  */
+  #define LCD_COST_XFER_US          10
+  #define LCD_COST_EXEC_US          37    // Most instructions
+  #define LCD_COST_DATA_US          41    // Data write, 37 us + tADD
+  #define LCD_COST_CLEAR_US       1520    // CLR_DISP
+
+/** Largest run of unchanged cells that still counts as part of one
+  * field for LCD_FlushBudget().  Fields are never split across calls.
+  */
+  #define LCD_FLUSH_FIELD_GAP        2
+
+/** Presentation mode with a frame rate limit.
+  *
+  * In presentation mode the character API only draws into the frame
+  * buffer and LCD_Present() pushes at most one coalesced frame per
+  * interval.  Needs LCD_FRAMEBUFFER_SUPPORT.
+  */
+  //#define LCD_PRESENT_SUPPORT
+  #define LCD_PRESENT_INTERVAL_MS   66    // About 15 frames per second
+
+/** Buffered screen updates for interrupt handlers and multiple writers.
+  *
+  * Writers draw with LCD_DB_* into a drawing buffer without touching
+  * the bus, LCD_Swap() publishes a copy atomically and one consumer
+  * sends the differences with LCD_DB_Service().  Costs 320 bytes of
+  * RAM.  Needs LCD_FRAMEBUFFER_SUPPORT.
+  */
+  //#define LCD_DOUBLE_BUFFER_SUPPORT
+
+/** Lock-free draw queue for RTOS tasks and interrupt handlers.
+  *
+  * Any task or interrupt handler posts draw operations with LCD_Post*()
+  * in bounded time, and one display task runs them with
+  * LCD_QueueService().  Needs LCD_FRAMEBUFFER_SUPPORT.
+  */
+  //#define LCD_QUEUE_SUPPORT
+  #define LCD_QUEUE_DEPTH           8     // Power of two, 64 at most
+  #define LCD_QUEUE_TEXT_LEN        20    // Longest text per operation
+
 /** =================================
   * End of user configurable section
   * =================================
@@ -195,6 +446,10 @@
   #define LCD_READ_DD_SUPPORT
 #endif
 
+#if defined( LCD_VIEWPORT_SUPPORT ) && !defined( LCD_READCHAR_SUPPORT ) && !defined( LCD_FRAMEBUFFER_SUPPORT )
+  #error LCD_VIEWPORT_SUPPORT needs LCD_READCHAR_SUPPORT or LCD_FRAMEBUFFER_SUPPORT.
+#endif
+
 
 /** LCD Bus Bit defines
   */
@@ -258,6 +513,33 @@
 /** Public status bits returned by LCD_GetStatus(). */
 #define LCD_STATUS_OK               0b00000000
 #define LCD_STATUS_TIMEOUT          0b00000001
+#define LCD_STATUS_INIT_PENDING     0b00000010
+
+/** Public results returned by LCD_InitPoll(). */
+#define LCD_INIT_READY              0u
+#define LCD_INIT_PENDING            1u
+
+/** Operation classes used to split LCD_Stats.blocked_us_by_class. */
+#define LCD_STAT_CLASS_COMMAND      0u    // Fast instructions
+#define LCD_STAT_CLASS_CLEAR        1u    // CLR_DISP and RET_HOME
+#define LCD_STAT_CLASS_DATA         2u    // Data register writes
+#define LCD_STAT_CLASS_READ         3u    // DDRAM reads
+#define LCD_STAT_CLASS_COUNT        4u
+
+/** Public results returned by LCD_FlushBudget() and LCD_FlushFields(). */
+#define LCD_FLUSH_DONE              0u
+#define LCD_FLUSH_PENDING           1u
+
+/** Public results returned by LCD_Scrub(). */
+#define LCD_SCRUB_CLEAN             0u    // Every cell checked was right
+#define LCD_SCRUB_REPAIRED          1u    // Some cells were rewritten
+#define LCD_SCRUB_RESYNCED          2u    // The controller was recovered
+#define LCD_SCRUB_FAILED            3u    // The controller did not answer
+
+/** Pixel modes for the LCD_Canvas drawing functions. */
+#define LCD_PIXEL_CLEAR             0u
+#define LCD_PIXEL_SET               1u
+#define LCD_PIXEL_TOGGLE            2u
 
 /** Public result values returned by LCD read helpers. */
 #define LCD_RESULT_ERROR            0u
@@ -457,6 +739,17 @@
   */
               void LCD_Init         ( void );
 
+#ifdef LCD_INIT_ASYNC_SUPPORT
+/** Initialize without blocking.
+  *
+  * LCD_InitAsync() starts the same sequence as LCD_Init().  Then call
+  * LCD_InitPoll() from a tick or the main loop until it returns
+  * LCD_INIT_READY, and use no other LCD API before that.
+  */
+              void LCD_InitAsync    ( void );
+              uint8_t LCD_InitPoll  ( void );
+#endif
+
 /** Move the cursor to a display coordinate.
   *
   * Coordinates are interpreted using the currently selected panel map.
@@ -473,6 +766,7 @@
 /** Return the current driver status bitmask.
   *
   * LCD_STATUS_TIMEOUT indicates that an LCD busy wait timed out.
+  * LCD_STATUS_INIT_PENDING is set while LCD_InitAsync() is running.
   */
               uint8_t LCD_GetStatus ( void );
 
@@ -482,6 +776,111 @@
   */
               void LCD_ClearStatus  ( void );
 
+#ifdef LCD_RECOVER_SUPPORT
+/** Re-synchronise with the controller and restore its state.
+  *
+  * Much faster than LCD_Init() and the screen is not cleared.  Also
+  * clears LCD_STATUS_TIMEOUT.  Returns LCD_RESULT_OK on success.
+  */
+              uint8_t LCD_Recover   ( void );
+#endif
+
+#ifdef LCD_TUNE_SUPPORT
+/** Bus delays in delay_cycles() units. */
+typedef struct
+{
+  uint8_t setup;          // After RS and R/W change
+  uint8_t pulse;          // With E high
+  uint8_t hold;           // After E falls
+} LCD_Timing;
+
+/** Find the fastest bus timing that reads back correctly, add
+  * LCD_TUNE_MARGIN_PERCENT and use it.
+  *
+  * Starts from the timing in use, which must already work.  A failing
+  * trial is followed by LCD_Recover(), so run it before drawing or with
+  * LCD_FRAMEBUFFER_SUPPORT.  The tested cells are put back afterwards.
+  * Returns LCD_RESULT_OK and, if timing is not NULL, the result.
+  */
+              uint8_t LCD_Tune      ( LCD_Timing * timing );
+
+/** Read the timing in use, for storing. */
+              void LCD_GetTiming    ( LCD_Timing * timing );
+
+/** Use a stored timing, or E_CYCLES throughout if timing is NULL. */
+              void LCD_SetTiming    ( const LCD_Timing * timing );
+#endif
+
+#ifdef LCD_STATS_SUPPORT
+/** Driver counters collected since LCD_Init() or LCD_ResetStats().
+  *
+  * Counters removed from the build by the configuration stay at zero.
+  * busy_wait_hist[ 0 ] counts busy waits that never saw the busy flag
+  * set, bucket n counts waits of 2^(n-1) to 2^n - 1 busy polls, and the
+  * last bucket collects everything longer.
+  */
+typedef struct
+{
+  uint32_t commands;
+  uint32_t data_bytes;
+  uint32_t strobes;
+  uint32_t busy_polls;
+  uint32_t pin_reconfigs;
+  uint32_t bytes_skipped;
+  uint32_t timeouts;
+  uint32_t busy_wait_max;
+  uint32_t busy_wait_hist[ LCD_STATS_HIST_BUCKETS ];
+  uint32_t blocked_us;
+  uint32_t blocked_us_by_class[ LCD_STAT_CLASS_COUNT ];
+} LCD_Stats;
+
+/** Copy the current driver counters into stats. */
+              void LCD_GetStats     ( LCD_Stats * stats );
+
+/** Reset all driver counters to zero. */
+              void LCD_ResetStats   ( void );
+#endif
+
+#ifdef LCD_TRACE_SUPPORT
+/** Trace entry flags. */
+#define LCD_TRACE_RS                0x01u   // Data register, otherwise instruction
+#define LCD_TRACE_READ              0x02u   // Read cycle, otherwise write
+#define LCD_TRACE_NIBBLE_PAIR       0x04u   // Sent as two 4-bit transfers
+#define LCD_TRACE_NIBBLE_ONLY       0x08u   // Single 4-bit bootstrap transfer
+#define LCD_TRACE_BUSY              0x10u   // Busy flag read
+
+/** One recorded bus transaction.
+  *
+  * For busy flag reads, value holds BF as last seen and polls counts the
+  * consecutive reads folded into this entry.
+  */
+typedef struct
+{
+  uint32_t timestamp;     // LCD_Time_us() at the start of the transaction
+  uint8_t  flags;         // LCD_TRACE_* flags
+  uint8_t  value;         // Byte written or read
+  uint16_t polls;         // Busy flag reads folded into this entry
+} LCD_TraceEntry;
+
+/** Pause or resume trace recording. Recording is on after reset. */
+              void LCD_TraceEnable  ( uint8_t enable );
+
+/** Discard all recorded trace entries. */
+              void LCD_TraceClear   ( void );
+
+/** Remove up to max_entries of the oldest entries from the trace.
+  *
+  * Returns the number of entries copied into entries.
+  */
+          uint16_t LCD_TraceRead    ( LCD_TraceEntry * entries, uint16_t max_entries );
+
+/** Format one entry as a dump line for tools/hd_trace2vcd.c.
+  *
+  * Returns the snprintf-style length of the line.
+  */
+               int LCD_TraceFormat  ( const LCD_TraceEntry * entry, char * buffer, uint16_t size );
+#endif
+
 #ifdef __CROSSWORKS_ARM
 int __putchar(int ch, __printf_tag_ptr ptr);
 #endif
@@ -533,6 +932,51 @@ uint8_t LCD_Readchar      ( uint8_t rc_x, uint8_t rc_y, uint8_t * rc_data );
 /** Write a null-terminated string directly to the display. */
 void LCD_Puts             ( const char * string );
 
+#ifdef LCD_VIEWPORT_SUPPORT
+/** Viewport flags. */
+#define LCD_VP_SCROLL               0x01u   // Scroll at the bottom, otherwise wrap to the top
+#define LCD_VP_NL_DOES_CR           0x02u   // '\n' also returns to column 0
+
+/** A rectangular text window with its own cursor.
+  *
+  * Set up with LCD_VP_Init() and treat the members as read-only.
+  */
+typedef struct
+{
+  uint8_t x, y;             // Top left corner on the panel
+  uint8_t width, height;    // Size in characters
+  uint8_t xpos, ypos;       // Cursor, relative to the viewport
+  uint8_t wrap_pending;
+  uint8_t flags;            // LCD_VP_* flags
+} LCD_Viewport;
+
+/** Set up a viewport, clipped to the panel, with its cursor at 0, 0.
+  *
+  * A width or height of 0 extends the viewport to the panel edge.
+  */
+void LCD_VP_Init          ( LCD_Viewport * vp, uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t flags );
+
+/** Move a viewport's cursor, relative to the viewport. */
+void LCD_VP_Locate        ( LCD_Viewport * vp, uint8_t x, uint8_t y );
+
+/** Write one character to a viewport.
+  *
+  * Same rules as LCD_Putchar(), applied inside the viewport.  Only cells
+  * inside the viewport are ever written, and the global cursor used by
+  * LCD_Putchar() is left alone.
+  */
+uint8_t LCD_VP_Putchar    ( LCD_Viewport * vp, uint8_t ch );
+
+/** Write a null-terminated string to a viewport. */
+void LCD_VP_Puts          ( LCD_Viewport * vp, const char * string );
+
+/** Fill a viewport with spaces and home its cursor. */
+void LCD_VP_Clear         ( LCD_Viewport * vp );
+
+/** Scroll a viewport's contents up one line. */
+void LCD_VP_Scroll        ( LCD_Viewport * vp );
+#endif
+
 #ifdef LCD_PRINTF_SUPPORT
 /** Format a message and write it to the display.
   *
@@ -544,6 +988,183 @@ int LCD_Printf            ( const char * format, ... );
 /** Clear the display and return the cursor to the home position. */
 void LCD_Clear            ( void );
 
+#ifdef LCD_FRAMEBUFFER_SUPPORT
+/** Fill the frame buffer with spaces.
+  *
+  * Like all LCD_FB_* drawing, nothing is sent until LCD_Flush().
+  */
+void LCD_FB_Clear         ( void );
+
+/** Draw one character into the frame buffer. Off-panel cells are ignored. */
+void LCD_FB_Putc          ( uint8_t x, uint8_t y, uint8_t ch );
+
+/** Draw a string into the frame buffer, clipped at the end of the row. */
+void LCD_FB_Puts          ( uint8_t x, uint8_t y, const char * string );
+
+/** Read one character back from the frame buffer. */
+uint8_t LCD_FB_Getc       ( uint8_t x, uint8_t y );
+
+/** Send the frame buffer to the display.
+  *
+  * The planner prices a differential update against a CLR_DISP followed
+  * by sparse writes, using the LCD_COST_* model, and runs the cheaper.
+  */
+void LCD_Flush            ( void );
+
+/** Return the modelled cost in microseconds of the next LCD_Flush(). */
+uint32_t LCD_FlushCost    ( void );
+
+/** Send pending updates until max_us has been used, then return.
+  *
+  * The next call resumes where this one stopped.  Runs of changed cells
+  * are sent whole, so a field never shows half old and half new.
+  * Returns LCD_FLUSH_DONE or LCD_FLUSH_PENDING.
+  */
+uint8_t LCD_FlushBudget   ( uint32_t max_us );
+
+/** As LCD_FlushBudget(), but limited to max_fields runs of changed cells. */
+uint8_t LCD_FlushFields   ( uint16_t max_fields );
+
+#ifdef LCD_SCREEN_SUPPORT
+/** Field alignment for screen templates. */
+#define LCD_FIELD_LEFT              0u
+#define LCD_FIELD_RIGHT             1u
+
+typedef struct
+{
+  uint8_t      x, y;
+  const char * text;        // NULL ends the list
+} LCD_Label;
+
+typedef struct
+{
+  uint8_t x, y;
+  uint8_t width;            // 0 ends the list
+  uint8_t align;            // LCD_FIELD_LEFT or LCD_FIELD_RIGHT
+} LCD_Field;
+
+typedef struct
+{
+  const LCD_Label * labels;
+  const LCD_Field * fields;
+  uint8_t           field_count;
+} LCD_Screen;
+
+/** Build a screen template at compile time from an X-macro table.
+  *
+  * Each entry is LABEL( x, y, "text" ) or FIELD( id, x, y, width, align ).
+  * LCD_SCREEN_FIELD_IDS() numbers the fields in table order, and
+  * LCD_SCREEN() makes a const LCD_Screen, so the whole template and its
+  * label text stay in flash.
+  *
+  *   #define MAIN_SCREEN( LABEL, FIELD ) \
+  *     LABEL( 0, 0, "Temp" ) FIELD( F_TEMP, 5, 0, 6, LCD_FIELD_RIGHT ) \
+  *     LABEL( 0, 1, "Mode" ) FIELD( F_MODE, 5, 1, 8, LCD_FIELD_LEFT )
+  *
+  *   LCD_SCREEN_FIELD_IDS( MAIN_SCREEN );
+  *   LCD_SCREEN( main_screen, MAIN_SCREEN );
+  */
+#define LCD_SCREEN_SKIP( ... )
+#define LCD_SCREEN_LABEL( x, y, text )              { ( x ), ( y ), ( text ) },
+#define LCD_SCREEN_FIELD( id, x, y, width, align )  { ( x ), ( y ), ( width ), ( align ) },
+#define LCD_SCREEN_FIELD_ID( id, x, y, width, align ) id,
+
+#define LCD_SCREEN_FIELD_IDS( table ) \
+  enum { table( LCD_SCREEN_SKIP, LCD_SCREEN_FIELD_ID ) }
+
+#define LCD_SCREEN( name, table ) \
+  static const LCD_Label name##_labels[] = { table( LCD_SCREEN_LABEL, LCD_SCREEN_SKIP ) { 0, 0, NULL } }; \
+  static const LCD_Field name##_fields[] = { table( LCD_SCREEN_SKIP, LCD_SCREEN_FIELD ) { 0, 0, 0, 0 } }; \
+  static const LCD_Screen name = { name##_labels, name##_fields, \
+                                   sizeof( name##_fields ) / sizeof( name##_fields[ 0 ] ) - 1 }
+
+/** Draw a screen's labels into the frame buffer and blank the rest.
+  *
+  * The next LCD_Flush() sends only what differs from the glass, so
+  * labels already showing cost nothing.
+  */
+void LCD_ScreenShow       ( const LCD_Screen * screen );
+
+/** Draw text into a field of the current screen, padded with spaces
+  * and clipped to the field.  Returns LCD_RESULT_ERROR for a bad id.
+  */
+uint8_t LCD_ScreenField   ( uint8_t id, const char * text );
+#endif
+
+#ifdef LCD_DOUBLE_BUFFER_SUPPORT
+/** Draw into the drawing buffer.  Safe from interrupt handlers and
+  * never touches the bus or the global cursor.
+  */
+void LCD_DB_Putc          ( uint8_t x, uint8_t y, uint8_t ch );
+void LCD_DB_Puts          ( uint8_t x, uint8_t y, const char * string );
+void LCD_DB_Clear         ( void );
+
+/** Publish a copy of the drawing buffer atomically.
+  *
+  * Call from the context that finished drawing the frame.  A write from
+  * another context racing the swap lands in this frame or the next, and
+  * a swap interrupting another is folded into it.
+  */
+void LCD_Swap             ( void );
+
+/** Send the latest published frame.  Call from a single consumer.
+  *
+  * max_us works as for LCD_FlushBudget(), 0 sends everything.
+  * Returns LCD_FLUSH_DONE or LCD_FLUSH_PENDING.
+  */
+uint8_t LCD_DB_Service    ( uint32_t max_us );
+#endif
+
+#ifdef LCD_QUEUE_SUPPORT
+/** Post draw operations from any task or interrupt handler.
+  *
+  * None of these touch the bus.  They return 1 if the operation was
+  * queued or 0 if the queue was full.  LCD_PostField() pads or clips the
+  * text to exactly width characters.
+  */
+uint8_t LCD_Post          ( uint8_t x, uint8_t y, const char * string );
+uint8_t LCD_PostField     ( uint8_t x, uint8_t y, uint8_t width, const char * string );
+#ifdef LCD_UDG_SUPPORT
+uint8_t LCD_PostGlyph     ( uint8_t ChToSet, const uint8_t * ChDataset );
+#endif
+
+/** Run queued operations, coalesced, from the single display task.
+  *
+  * max_us works as for LCD_FlushBudget(), 0 sends everything.
+  * Returns LCD_FLUSH_DONE or LCD_FLUSH_PENDING.
+  */
+uint8_t LCD_QueueService  ( uint32_t max_us );
+#endif
+
+#ifdef LCD_SCRUB_SUPPORT
+/** Check max_cells more cells against the glass record and repair them.
+  *
+  * Call regularly from the main loop.  Returns one of LCD_SCRUB_*.
+  */
+uint8_t LCD_Scrub         ( uint8_t max_cells );
+#endif
+
+#ifdef LCD_PRESENT_SUPPORT
+/** Enter or leave presentation mode.
+  *
+  * While enabled, LCD_Putchar(), LCD_Puts(), LCD_Printf(), LCD_Locate(),
+  * LCD_Clear() and LCD_ScrollUp() update only the frame buffer.  Leaving
+  * presentation mode flushes the frame.
+  */
+void LCD_PresentMode      ( uint8_t enable );
+
+/** Set the frame rate limit for LCD_Present(), 0 for no limit. */
+void LCD_PresentRate      ( uint8_t hz );
+
+/** Push the current frame if the frame interval has passed.
+  *
+  * Call this often, for example every main loop pass.  Returns 1 if a
+  * frame was sent.
+  */
+uint8_t LCD_Present       ( void );
+#endif
+#endif
+
 #ifdef LCD_UDG_SUPPORT
 /** Define one user character in CGRAM.
   *
@@ -553,6 +1174,218 @@ void LCD_Clear            ( void );
 void LCD_Defchar          ( uint16_t ChToSet, const uint8_t * ChDataset );
 #endif
 
+#ifdef LCD_CANVAS_SUPPORT
+/** Draw into a pixel canvas held in CGRAM.
+  *
+  * The canvas is LCD_CANVAS_COLS * 5 pixels wide and LCD_CANVAS_ROWS
+  * character rows high.  Drawing changes only the driver's copy;
+  * LCD_CanvasUpload(), or LCD_Flush() with the frame buffer, sends the
+  * CGRAM rows that changed.  LCD_CanvasPlace() puts the cells on screen
+  * once with their top-left corner at (x, y).
+  */
+void LCD_CanvasClear      ( void );
+void LCD_CanvasPixel      ( uint8_t x, uint8_t y, uint8_t mode );
+uint8_t LCD_CanvasGetPixel( uint8_t x, uint8_t y );
+void LCD_CanvasLine       ( uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t mode );
+void LCD_CanvasFill       ( uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t mode );
+void LCD_CanvasPlace      ( uint8_t x, uint8_t y );
+uint8_t LCD_CanvasUpload  ( void );
+#endif
+
+#ifdef LCD_GLYPH_PACK_SUPPORT
+/** Build a glyph pack at compile time from an X-macro table.
+  *
+  * Each table entry is X( row0, row1, ... ) with LCD_CGRAM_CHAR_ROWS
+  * rows.  The pack is a two byte header, rows per glyph and glyph count,
+  * then the rows of each glyph packed 5 bits at a time, MSB first, and
+  * padded to a whole byte: 5 bytes per 5x8 glyph, 7 per 5x10 glyph.
+  *
+  *   #define ICONS( X ) \
+  *     X( 0x00, 0x0A, 0x1F, 0x1F, 0x1F, 0x0E, 0x04, 0x00 ) \
+  *     X( 0x04, 0x0E, 0x1F, 0x04, 0x04, 0x04, 0x04, 0x00 )
+  *
+  *   static const uint8_t icons[] = { LCD_GLYPH_PACK( ICONS ) };
+  */
+#define LCD_GLYPH_PACK( table )     LCD_CGRAM_CHAR_ROWS, ( 0 table( LCD_GLYPH_PACK_COUNT ) ), table( LCD_GLYPH_PACK_ROWS )
+
+#define LCD_GLYPH_PACK_COUNT( ... ) + 1
+#define LCD_GLYPH_PACK_5BIT( b, n ) ( ( uint8_t )( ( b ) & ( ( 1u << ( n ) ) - 1u ) ) )
+
+#define LCD_GLYPH_PACK_40( r0, r1, r2, r3, r4, r5, r6, r7 ) \
+  ( uint8_t )( LCD_GLYPH_PACK_5BIT( r0, 5 ) << 3 | LCD_GLYPH_PACK_5BIT( r1, 5 ) >> 2 ), \
+  ( uint8_t )( LCD_GLYPH_PACK_5BIT( r1, 2 ) << 6 | LCD_GLYPH_PACK_5BIT( r2, 5 ) << 1 | LCD_GLYPH_PACK_5BIT( r3, 5 ) >> 4 ), \
+  ( uint8_t )( LCD_GLYPH_PACK_5BIT( r3, 4 ) << 4 | LCD_GLYPH_PACK_5BIT( r4, 5 ) >> 1 ), \
+  ( uint8_t )( LCD_GLYPH_PACK_5BIT( r4, 1 ) << 7 | LCD_GLYPH_PACK_5BIT( r5, 5 ) << 2 | LCD_GLYPH_PACK_5BIT( r6, 5 ) >> 3 ), \
+  ( uint8_t )( LCD_GLYPH_PACK_5BIT( r6, 3 ) << 5 | LCD_GLYPH_PACK_5BIT( r7, 5 ) )
+
+#if LCD_CHAR_FONT == LCD_CHAR_FONT_5X10
+#define LCD_GLYPH_PACK_ROWS( r0, r1, r2, r3, r4, r5, r6, r7, r8, r9, r10 ) \
+  LCD_GLYPH_PACK_40( r0, r1, r2, r3, r4, r5, r6, r7 ), \
+  ( uint8_t )( LCD_GLYPH_PACK_5BIT( r8, 5 ) << 3 | LCD_GLYPH_PACK_5BIT( r9, 5 ) >> 2 ), \
+  ( uint8_t )( LCD_GLYPH_PACK_5BIT( r9, 2 ) << 6 | LCD_GLYPH_PACK_5BIT( r10, 5 ) << 1 ),
+#else
+#define LCD_GLYPH_PACK_ROWS( r0, r1, r2, r3, r4, r5, r6, r7 ) \
+  LCD_GLYPH_PACK_40( r0, r1, r2, r3, r4, r5, r6, r7 ),
+#endif
+
+/** Load a glyph pack into CGRAM from first_slot up in one burst.
+  *
+  * Returns LCD_RESULT_ERROR if the pack is for the other font or does
+  * not fit in the slots left.
+  */
+uint8_t LCD_LoadGlyphPack ( const uint8_t * pack, uint8_t first_slot );
+#endif
+
+#ifdef LCD_ANIM_SUPPORT
+/** Animate custom characters.
+  *
+  * frames holds count patterns of LCD_CGRAM_CHAR_ROWS bytes each and is
+  * kept by reference, so it may live in flash.  LCD_AnimStart() returns
+  * LCD_RESULT_ERROR when every animation is in use or count is out of
+  * range.  LCD_AnimTick() never waits for a frame; it sends the rows
+  * that change in the animations that are due and returns how many.
+  */
+uint8_t LCD_AnimStart     ( uint8_t slot, const uint8_t * frames, uint8_t count, uint16_t interval_ms );
+void LCD_AnimStop         ( uint8_t slot );
+uint8_t LCD_AnimTick      ( void );
+#endif
+
+#ifdef LCD_WIDGET_SUPPORT
+/** Bar directions for LCD_BarInit(). */
+#define LCD_BAR_HORIZONTAL          0u    // Grows right, 5 steps per cell
+#define LCD_BAR_VERTICAL            1u    // Grows up from y, 8 steps per cell
+
+/** A bar graph.  Set up with LCD_BarInit(); the members are read-only. */
+typedef struct
+{
+  uint8_t  x, y;            // First cell, the bottom one for vertical bars
+  uint8_t  length;          // Size in cells
+  uint8_t  direction;       // LCD_BAR_HORIZONTAL or LCD_BAR_VERTICAL
+  uint16_t shown;           // Value on the glass, 0xFFFF before the first draw
+} LCD_Bar;
+
+/** A big number, 3 columns per digit plus a gap column, 2 or 3 rows. */
+typedef struct
+{
+  uint8_t  x, y;            // Top left corner
+  uint8_t  digits;          // Digit positions
+  uint8_t  rows;            // 2 or 3
+  uint8_t  shown[ LCD_BIGNUM_DIGITS ];
+} LCD_BigNum;
+
+/** Draw widgets, rewriting only the cells that change.
+  *
+  * LCD_BarSet() takes the bar length in steps, 0 to length * 5 for
+  * horizontal bars or length * 8 for vertical ones.  LCD_BigNumSet()
+  * shows value right-aligned without leading zeros, and its low digits
+  * if it does not fit.
+  */
+void LCD_BarInit          ( LCD_Bar * bar, uint8_t x, uint8_t y, uint8_t length, uint8_t direction );
+void LCD_BarSet           ( LCD_Bar * bar, uint16_t value );
+void LCD_BigNumInit       ( LCD_BigNum * num, uint8_t x, uint8_t y, uint8_t digits, uint8_t rows );
+void LCD_BigNumSet        ( LCD_BigNum * num, uint32_t value );
+#endif
+
+#ifdef LCD_WAVE_SUPPORT
+/** Compile bus writes into a DMA waveform and play it.
+  *
+  * LCD_WaveCommand(), LCD_WaveData() and LCD_WaveWrite() append to the
+  * waveform and return LCD_RESULT_ERROR when it is full or playing.
+  * LCD_WaveWords() gives the words for inspection.  LCD_WaveStart()
+  * plays them and calls done, if not NULL, from the DMA interrupt at
+  * the end, or drops them as LCD_WaveReset() does if they cannot play.
+  * Use no other LCD API until LCD_WaveBusy() returns 0.
+  */
+void LCD_WaveReset        ( void );
+uint8_t LCD_WaveCommand   ( uint8_t cmd );
+uint8_t LCD_WaveData      ( uint8_t dat );
+uint8_t LCD_WaveWrite     ( uint8_t x, uint8_t y, const char * string );
+const uint32_t * LCD_WaveWords( uint16_t * count );
+uint8_t LCD_WaveStart     ( void ( *done )( void ) );
+uint8_t LCD_WaveBusy      ( void );
+#endif
+
+#if defined( LCD_UTF8_SUPPORT ) && defined( LCD_UTF8_CGRAM_FALLBACK )
+/** Register a CGRAM glyph to show for a code point the ROM lacks.
+  *
+  * The pattern is kept by reference, so it may live in flash.
+  * Returns LCD_RESULT_OK, or LCD_RESULT_ERROR when the table is full.
+  */
+uint8_t LCD_UTF8_AddGlyph ( uint16_t cp, const uint8_t * pattern );
+#endif
+
+#ifdef LCD_MARQUEE_SUPPORT
+/** Scroll a line of text with display shift instructions.
+  *
+  * LCD_MarqueeStart() writes the text into the whole DDRAM line once.
+  * Each LCD_MarqueeTick() after interval_ms then costs one instruction.
+  * The shift moves every row of the display.  LCD_MarqueeStop() puts
+  * the display back unshifted.
+  */
+void LCD_MarqueeStart     ( uint8_t y, const char * string, uint16_t interval_ms );
+uint8_t LCD_MarqueeTick   ( void );
+void LCD_MarqueeStop      ( void );
+#endif
+
+#ifdef LCD_PAGE_SUPPORT
+/** Pre-render screens off screen and flip between them.
+  *
+  * LCD_PageDraw() picks the page that LCD_Locate() and the output
+  * functions address.  LCD_PageShow() brings a page into view, without
+  * rewriting DDRAM, and draws to it from then on.  LCD_PageShown()
+  * returns 0xFF if the display was shifted by other means.
+  */
+void LCD_PageDraw         ( uint8_t page );
+void LCD_PageShow         ( uint8_t page );
+uint8_t LCD_PageShown     ( void );
+uint8_t LCD_PageCount     ( void );
+#endif
+
+#ifdef LCD_VT100_SUPPORT
+/** Display a VT100 stream.
+  *
+  * Handles CUP, cursor up, down, left and right, EL, ED, DECSC/DECRC,
+  * SCOSC/SCORC and RIS; SGR and other sequences are skipped.  Either
+  * call LCD_VT100_Write() with each byte, or LCD_VT100_Receive() from
+  * the UART interrupt and LCD_VT100_Service() from the main loop.
+  * LCD_VT100_Receive() returns LCD_RESULT_ERROR when the ring is full.
+  */
+void LCD_VT100_Write       ( uint8_t byte );
+uint8_t LCD_VT100_Receive  ( uint8_t byte );
+uint16_t LCD_VT100_Service ( uint16_t max_bytes );
+#endif
+
+#ifdef LCD_RIGHT_ALIGN_SUPPORT
+/** Write a decimal number that ends at column x.
+  *
+  * Digits are sent least significant first with the address counter
+  * decrementing, so no buffer is needed.  The entry mode stays
+  * decrementing until the next other data write, so a run of fields
+  * pays for the mode switches once.  The driver cursor does not move.
+  */
+void LCD_PutNumberRight   ( uint8_t x, uint8_t y, int32_t value, uint8_t width );
+#endif
+
+#ifdef LCD_CONSOLE_SUPPORT
+/** Console flags for LCD_ConsoleInit(). */
+#define LCD_CONSOLE_ORDERED         0x00u   // Newest line at the bottom
+#define LCD_CONSOLE_ROLL            0x01u   // New lines replace the oldest row
+
+/** A log console over the whole panel, with scrollback.
+  *
+  * Lines scrolled off the panel stay in a RAM ring and
+  * LCD_ConsoleScroll() moves the view back, positive, or forward,
+  * negative, through them.  Only rows that differ from what is shown
+  * are rewritten.  In LCD_CONSOLE_ROLL mode the live view writes each
+  * new line over the oldest row, so a line costs one row write, but the
+  * rows are not in time order; the scrolled-back view is always ordered.
+  */
+void LCD_ConsoleInit      ( uint8_t flags );
+void LCD_ConsolePutc      ( uint8_t ch );
+void LCD_ConsolePuts      ( const char * string );
+void LCD_ConsoleScroll    ( int16_t lines );
+#endif
+
 #ifdef LCD_SCROLL_SUPPORT
 /** Scroll the current display contents up by one line. */
 void LCD_ScrollUp         ( void );
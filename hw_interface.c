@@ -85,3 +85,32 @@ uint8_t Read_Pin( uint16_t GPIO_Pin, GPIO_TypeDef *GPIOx )
 
   return HAL_GPIO_ReadPin( GPIOx, GPIO_Pin );
 }
+
+
+/** Read a free running microsecond count.
+  *
+  * Built from the HAL millisecond tick and the SysTick down counter, so
+  * it wraps cleanly at 2^32 and differences between readings are valid.
+  * A pending tick is counted, so it keeps going for one more millisecond
+  * with interrupts masked.
+  *
+  * @param none
+  * @retval microseconds since the tick started
+  */
+uint32_t Read_Micros( void )
+{
+  uint32_t ms, ticks, late;
+
+  do
+  {
+    ms    = HAL_GetTick();
+    ticks = SysTick->VAL;
+
+    /* A reload whose interrupt is pending or masked is not in ms yet,
+       so count it here and read the counter again after it. */
+    late  = ( SCB->ICSR & SCB_ICSR_PENDSTSET_Msk ) ? 1u : 0u;
+    if( late ) ticks = SysTick->VAL;
+  } while( ms != HAL_GetTick() );
+
+  return ( ms + late ) * 1000u + ( ( SysTick->LOAD - ticks ) * 1000u ) / ( SysTick->LOAD + 1u );
+}
@@ -14,3 +14,4 @@ void Output_Pin         ( uint16_t pin_to_wr, GPIO_TypeDef* port, char bit );
 void Output_Pin_NoDDR   ( uint16_t pin_to_wr, GPIO_TypeDef* port, char bit );
 void Set_Input_Pin      ( int pin_to_hiz, GPIO_TypeDef* port );
 uint8_t Read_Pin        ( uint16_t GPIO_Pin, GPIO_TypeDef *GPIOx );
+uint32_t Read_Micros    ( void );
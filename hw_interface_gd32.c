@@ -2,9 +2,12 @@
 //#include "gd32f10x.h"
 
 volatile uint32_t TickCounter = 0;
+volatile uint32_t MillisCounter = 0;
 
 void SysTick_Handler( void )
 {
+  MillisCounter++;
+
   if( TickCounter )
   {
     TickCounter--;
@@ -17,6 +20,31 @@ void delay_millis( uint32_t wait_time )
   while( TickCounter );
 }
 
+/** Read a free running microsecond count.
+  *
+  * Assumes SysTick is set up for a 1 ms interrupt.  The result wraps
+  * cleanly at 2^32 so differences between readings are valid.  A
+  * pending tick is counted, so it keeps going for one more millisecond
+  * with interrupts masked.
+  */
+uint32_t Read_Micros( void )
+{
+  uint32_t ms, ticks, late;
+
+  do
+  {
+    ms    = MillisCounter;
+    ticks = SysTick->VAL;
+
+    /* A reload whose interrupt is pending or masked is not in ms yet,
+       so count it here and read the counter again after it. */
+    late  = ( SCB->ICSR & SCB_ICSR_PENDSTSET_Msk ) ? 1u : 0u;
+    if( late ) ticks = SysTick->VAL;
+  } while( ms != MillisCounter );
+
+  return ( ms + late ) * 1000u + ( ( SysTick->LOAD - ticks ) * 1000u ) / ( SysTick->LOAD + 1u );
+}
+
 
 /** Sets up a pin at a specifc output state.
   *
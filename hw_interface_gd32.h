@@ -10,6 +10,7 @@
   *
   */
 void delay_millis       ( uint32_t wait_time );
+uint32_t Read_Micros    ( void );
 void Output_Pin         ( uint32_t pin_to_wr, uint32_t port, char bit );
 void Output_Pin_NoDDR   ( uint32_t pin_to_wr, uint32_t port, char bit );
 void Set_Input_Pin      ( uint32_t pin_to_hiz, uint32_t port );
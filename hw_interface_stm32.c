@@ -86,3 +86,85 @@ uint8_t Read_Pin( uint16_t GPIO_Pin, GPIO_TypeDef *GPIOx )
 
   return HAL_GPIO_ReadPin( GPIOx, GPIO_Pin );
 }
+
+
+/** Read a free running microsecond count.
+  *
+  * Built from the HAL millisecond tick and the SysTick down counter, so
+  * it wraps cleanly at 2^32 and differences between readings are valid.
+  * A pending tick is counted, so it keeps going for one more millisecond
+  * with interrupts masked.
+  *
+  * @param none
+  * @retval microseconds since the tick started
+  */
+uint32_t Read_Micros( void )
+{
+  uint32_t ms, ticks, late;
+
+  do
+  {
+    ms    = HAL_GetTick();
+    ticks = SysTick->VAL;
+
+    /* A reload whose interrupt is pending or masked is not in ms yet,
+       so count it here and read the counter again after it. */
+    late  = ( SCB->ICSR & SCB_ICSR_PENDSTSET_Msk ) ? 1u : 0u;
+    if( late ) ticks = SysTick->VAL;
+  } while( ms != HAL_GetTick() );
+
+  return ( ms + late ) * 1000u + ( ( SysTick->LOAD - ticks ) * 1000u ) / ( SysTick->LOAD + 1u );
+}
+
+
+#ifdef LCD_WAVE_TIM
+
+extern TIM_HandleTypeDef LCD_WAVE_TIM;
+
+static void ( *wave_done )( void );
+
+
+/** Stop the pacing timer once the DMA has written the last word.
+  *
+  * @param hdma: DMA handle of the timer update request
+  * @retval none
+  */
+static void Wave_Complete( DMA_HandleTypeDef *hdma )
+{
+  ( void )hdma;
+
+  __HAL_TIM_DISABLE_DMA( &LCD_WAVE_TIM, TIM_DMA_UPDATE );
+  HAL_TIM_Base_Stop( &LCD_WAVE_TIM );
+
+  if( wave_done ) wave_done();
+}
+
+
+/** Play BSRR words to a port, one per timer update.
+  *
+  * @param port: GPIO port holding the LCD bus
+  * @param words: words to write to port->BSRR
+  * @param count: number of words
+  * @param done: called from the DMA interrupt at the end
+  * @retval 1 if started, 0 if the DMA is not set up or is in use
+  */
+uint8_t Wave_Play( GPIO_TypeDef* port, const uint32_t* words, uint16_t count, void ( *done )( void ) )
+{
+  DMA_HandleTypeDef *hdma = LCD_WAVE_TIM.hdma[ TIM_DMA_ID_UPDATE ];
+
+  if( hdma == NULL ) return 0;
+
+  wave_done               = done;
+  hdma->XferCpltCallback  = Wave_Complete;
+  hdma->XferErrorCallback = Wave_Complete;
+
+  if( HAL_DMA_Start_IT( hdma, ( uint32_t )words, ( uint32_t )&port->BSRR, count ) != HAL_OK ) return 0;
+
+  __HAL_TIM_SET_COUNTER( &LCD_WAVE_TIM, 0 );
+  __HAL_TIM_ENABLE_DMA( &LCD_WAVE_TIM, TIM_DMA_UPDATE );
+  HAL_TIM_Base_Start( &LCD_WAVE_TIM );
+
+  return 1;
+}
+
+#endif
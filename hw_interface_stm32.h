@@ -6,6 +6,13 @@
 
 #define PIN_SPEED_DEFAULT GPIO_SPEED_FREQ_LOW
 
+/** Timer that paces the LCD_WaveStart() DMA.
+  *
+  * Set its update period to LCD_WAVE_TICK_NS and link a memory to
+  * peripheral, word wide, normal mode DMA channel to its update request.
+  */
+//#define LCD_WAVE_TIM      htim6
+
 /** Exported Function Declarations
   *
   */
@@ -13,5 +20,9 @@ void Output_Pin         ( uint16_t pin_to_wr, GPIO_TypeDef* port, char bit );
 void Output_Pin_NoDDR   ( uint16_t pin_to_wr, GPIO_TypeDef* port, char bit );
 void Set_Input_Pin      ( int pin_to_hiz, GPIO_TypeDef* port );
 uint8_t Read_Pin        ( uint16_t GPIO_Pin, GPIO_TypeDef *GPIOx );
+uint32_t Read_Micros    ( void );
+#ifdef LCD_WAVE_TIM
+uint8_t Wave_Play       ( GPIO_TypeDef* port, const uint32_t* words, uint16_t count, void ( *done )( void ) );
+#endif
 
 #endif _HW_INTERFACE_STM32_H
@@ -0,0 +1,361 @@
+/*  HD44780-Driver  A display driver for the HD44780 based displays.
+    Copyright (C) 2024 Jennifer Gunn (JennyDigital).
+
+	jennifer.a.gunn@outlook.com
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+    USA
+*/
+
+/** Host tool: convert an LCD_TraceFormat() dump into a VCD waveform and a
+  * decoded command listing.
+  *
+  * Build:   cc -O2 -o hd_trace2vcd tools/hd_trace2vcd.c
+  * Usage:   hd_trace2vcd [-8] dump.txt trace.vcd > listing.txt
+  *
+  * Lines in the dump that do not start with "HDT " are ignored, so a raw
+  * UART capture with other log output mixed in can be fed in directly.
+  * Pass -8 if the driver was built with LCD_BUS8BIT.
+  */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/** Waveform timing in nanoseconds, relative to the start of a transaction.
+  *
+  * Trace timestamps only have microsecond resolution, so the strobes are
+  * drawn with nominal datasheet-like widths rather than measured ones.
+  */
+#define VCD_E_RISE_NS       100u
+#define VCD_E_WIDTH_NS      500u
+#define VCD_NIBBLE_GAP_NS   200u
+
+#define CLR_DISP            0x01u
+#define RET_HOME            0x02u
+#define ENT_MODE            0x04u
+#define DISP_CTRL           0x08u
+#define CURS_DISP_SH        0x10u
+#define FUNC_SET            0x20u
+#define SET_CGRAM_ADD       0x40u
+#define SET_DDRAM_ADD       0x80u
+
+
+typedef struct
+{
+  unsigned long timestamp;
+  char          reg;          // 'C' instruction, 'D' data
+  char          dir;          // 'W' write, 'R' read
+  unsigned int  value;
+  char          phase;        // 'P' nibble pair, 'N' single nibble, 'B' full byte
+  unsigned int  polls;
+} trace_line_t;
+
+
+/** Controller state followed through the trace to spot wasted writes. */
+typedef struct
+{
+  int           ac;           // Address counter, -1 if unknown
+  int           in_cgram;
+  int           increment;
+  int           last_disp_ctrl;
+  int           last_ent_mode;
+  int           last_func_set;
+} model_t;
+
+
+static FILE *          vcd;
+static unsigned long long vcd_now   = 0;
+static int             bus_8bit    = 0;
+
+static unsigned long   n_commands  = 0,
+                       n_data      = 0,
+                       n_reads     = 0,
+                       n_polls     = 0,
+                       n_wasted    = 0;
+
+
+static void vcd_time( unsigned long long t )
+{
+  if( t < vcd_now ) t = vcd_now;
+  if( t != vcd_now ) fprintf( vcd, "#%llu\n", t );
+  vcd_now = t;
+}
+
+
+static void vcd_bus( unsigned int value )
+{
+  int bit;
+  int width = bus_8bit ? 8 : 4;
+
+  fputc( 'b', vcd );
+  for( bit = width - 1; bit >= 0; bit-- )
+  {
+    fputc( ( value >> ( bus_8bit ? bit : bit + 4 ) ) & 1 ? '1' : '0', vcd );
+  }
+  fputs( " $\n", vcd );
+}
+
+
+static void vcd_header( void )
+{
+  fputs( "$version hd_trace2vcd $end\n", vcd );
+  fputs( "$timescale 1ns $end\n", vcd );
+  fputs( "$scope module hd44780 $end\n", vcd );
+  fputs( "$var wire 1 ! RS $end\n", vcd );
+  fputs( "$var wire 1 \" RNW $end\n", vcd );
+  fputs( "$var wire 1 # E $end\n", vcd );
+  fprintf( vcd, "$var wire %d $ DB $end\n", bus_8bit ? 8 : 4 );
+  fputs( "$var wire 1 % BF $end\n", vcd );
+  fputs( "$var integer 16 & polls $end\n", vcd );
+  fputs( "$upscope $end\n", vcd );
+  fputs( "$enddefinitions $end\n", vcd );
+  fputs( "#0\n$dumpvars\n0!\n0\"\n0#\n0%\nb0 &\n", vcd );
+  vcd_bus( 0 );
+  fputs( "$end\n", vcd );
+}
+
+
+/** Draw one E strobe with value on the bus, returning the end time. */
+static unsigned long long vcd_strobe( unsigned long long t, unsigned int value )
+{
+  vcd_time( t );
+  vcd_bus( value );
+  vcd_time( t + VCD_E_RISE_NS );
+  fputs( "1#\n", vcd );
+  vcd_time( t + VCD_E_RISE_NS + VCD_E_WIDTH_NS );
+  fputs( "0#\n", vcd );
+
+  return t + VCD_E_RISE_NS + VCD_E_WIDTH_NS + VCD_NIBBLE_GAP_NS;
+}
+
+
+static void vcd_transaction( const trace_line_t * line )
+{
+  unsigned long long t = ( unsigned long long )line->timestamp * 1000u;
+
+  vcd_time( t );
+  fprintf( vcd, "%c!\n%c\"\n", line->reg == 'D' ? '1' : '0', line->dir == 'R' ? '1' : '0' );
+
+  if( line->polls )
+  {
+    fprintf( vcd, "%c%%\n", ( line->value & 0x80u ) ? '1' : '0' );
+    fputs( "b", vcd );
+    {
+      int bit;
+      for( bit = 15; bit >= 0; bit-- ) fputc( ( line->polls >> bit ) & 1 ? '1' : '0', vcd );
+    }
+    fputs( " &\n", vcd );
+  }
+
+  t = vcd_strobe( t, line->value );
+  if( line->phase == 'P' ) vcd_strobe( t, ( line->value << 4 ) & 0xF0u );
+}
+
+
+static void list_command( unsigned int cmd, model_t * model, char * text, size_t size )
+{
+  int wasted = 0;
+
+  if( cmd & SET_DDRAM_ADD )
+  {
+    unsigned int addr = cmd & 0x7Fu;
+
+    wasted = !model->in_cgram && model->ac == ( int )addr;
+    snprintf( text, size, "SET_DDRAM_ADD 0x%02X", addr );
+    model->ac       = addr;
+    model->in_cgram = 0;
+  }
+  else if( cmd & SET_CGRAM_ADD )
+  {
+    unsigned int addr = cmd & 0x3Fu;
+
+    wasted = model->in_cgram && model->ac == ( int )addr;
+    snprintf( text, size, "SET_CGRAM_ADD 0x%02X (char %u row %u)", addr, addr >> 3, addr & 7u );
+    model->ac       = addr;
+    model->in_cgram = 1;
+  }
+  else if( cmd & FUNC_SET )
+  {
+    wasted = model->last_func_set == ( int )cmd;
+    snprintf( text, size, "FUNC_SET %s %s %s",
+              ( cmd & 0x10u ) ? "8-bit" : "4-bit",
+              ( cmd & 0x08u ) ? "2-line" : "1-line",
+              ( cmd & 0x04u ) ? "5x10" : "5x8" );
+    model->last_func_set = cmd;
+  }
+  else if( cmd & CURS_DISP_SH )
+  {
+    snprintf( text, size, "CURS_DISP_SH %s %s",
+              ( cmd & 0x08u ) ? "display" : "cursor",
+              ( cmd & 0x04u ) ? "right" : "left" );
+  }
+  else if( cmd & DISP_CTRL )
+  {
+    wasted = model->last_disp_ctrl == ( int )cmd;
+    snprintf( text, size, "DISP_CTRL %s%s%s",
+              ( cmd & 0x04u ) ? "on" : "off",
+              ( cmd & 0x02u ) ? " cursor" : "",
+              ( cmd & 0x01u ) ? " blink" : "" );
+    model->last_disp_ctrl = cmd;
+  }
+  else if( cmd & ENT_MODE )
+  {
+    wasted = model->last_ent_mode == ( int )cmd;
+    snprintf( text, size, "ENT_MODE %s%s", ( cmd & 0x02u ) ? "inc" : "dec", ( cmd & 0x01u ) ? " shift" : "" );
+    model->increment     = ( cmd & 0x02u ) != 0;
+    model->last_ent_mode = cmd;
+  }
+  else if( cmd & RET_HOME )
+  {
+    snprintf( text, size, "RET_HOME" );
+    model->ac       = 0;
+    model->in_cgram = 0;
+  }
+  else if( cmd & CLR_DISP )
+  {
+    snprintf( text, size, "CLR_DISP" );
+    model->ac        = 0;
+    model->in_cgram  = 0;
+    model->increment = 1;
+  }
+  else
+  {
+    snprintf( text, size, "NOP 0x%02X", cmd );
+  }
+
+  if( wasted )
+  {
+    n_wasted++;
+    strncat( text, "  ; redundant", size - strlen( text ) - 1 );
+  }
+}
+
+
+static void list_transaction( const trace_line_t * line, model_t * model, unsigned long delta )
+{
+  char text[ 96 ];
+
+  if( line->phase == 'N' )
+  {
+    snprintf( text, sizeof( text ), "INIT nibble 0x%X", line->value >> 4 );
+  }
+  else if( line->reg == 'C' && line->dir == 'W' )
+  {
+    n_commands++;
+    list_command( line->value, model, text, sizeof( text ) );
+  }
+  else if( line->reg == 'D' && line->dir == 'W' )
+  {
+    n_data++;
+    if( line->value >= 0x20u && line->value < 0x7Fu )
+      snprintf( text, sizeof( text ), "DATA 0x%02X '%c'", line->value, line->value );
+    else
+      snprintf( text, sizeof( text ), "DATA 0x%02X", line->value );
+
+    if( model->ac >= 0 ) model->ac += model->increment ? 1 : -1;
+  }
+  else if( line->reg == 'C' && line->polls )
+  {
+    n_polls += line->polls;
+    snprintf( text, sizeof( text ), "BUSY %s after %u poll%s",
+              ( line->value & 0x80u ) ? "still set" : "clear", line->polls, line->polls == 1 ? "" : "s" );
+  }
+  else if( line->reg == 'C' )
+  {
+    n_reads++;
+    snprintf( text, sizeof( text ), "READ AC 0x%02X", line->value & 0x7Fu );
+  }
+  else
+  {
+    n_reads++;
+    snprintf( text, sizeof( text ), "READ DATA 0x%02X", line->value );
+    if( model->ac >= 0 ) model->ac += model->increment ? 1 : -1;
+  }
+
+  printf( "%10lu  +%-7lu %c%c  %s\n", line->timestamp, delta, line->reg, line->dir, text );
+}
+
+
+static int parse_line( const char * text, trace_line_t * line )
+{
+  return sscanf( text, "HDT %lu %c %c %x %c %u",
+                 &line->timestamp, &line->reg, &line->dir,
+                 &line->value, &line->phase, &line->polls ) == 6;
+}
+
+
+int main( int argc, char ** argv )
+{
+  FILE *        in;
+  char          text[ 256 ];
+  trace_line_t  line;
+  model_t       model = { -1, 0, 1, -1, -1, -1 };
+  unsigned long first = 0, last = 0;
+  int           seen  = 0;
+  int           arg   = 1;
+
+  if( argc > arg && strcmp( argv[ arg ], "-8" ) == 0 )
+  {
+    bus_8bit = 1;
+    arg++;
+  }
+
+  if( argc - arg != 2 )
+  {
+    fprintf( stderr, "usage: %s [-8] dump.txt trace.vcd\n", argv[ 0 ] );
+    return 2;
+  }
+
+  in = strcmp( argv[ arg ], "-" ) ? fopen( argv[ arg ], "r" ) : stdin;
+  if( in == NULL )
+  {
+    perror( argv[ arg ] );
+    return 1;
+  }
+
+  vcd = fopen( argv[ arg + 1 ], "w" );
+  if( vcd == NULL )
+  {
+    perror( argv[ arg + 1 ] );
+    return 1;
+  }
+
+  vcd_header();
+
+  while( fgets( text, sizeof( text ), in ) )
+  {
+    const char * start = strstr( text, "HDT " );
+
+    if( start == NULL || !parse_line( start, &line ) ) continue;
+
+    if( !seen ) first = line.timestamp;
+    list_transaction( &line, &model, seen ? line.timestamp - last : 0 );
+    vcd_transaction( &line );
+
+    last = line.timestamp;
+    seen = 1;
+  }
+
+  printf( "\n%lu commands, %lu data writes, %lu reads, %lu busy polls, "
+          "%lu redundant, %lu us traced\n",
+          n_commands, n_data, n_reads, n_polls, n_wasted, seen ? last - first : 0 );
+
+  if( in != stdin ) fclose( in );
+  fclose( vcd );
+
+  return 0;
+}
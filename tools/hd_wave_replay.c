@@ -0,0 +1,450 @@
+/*  HD44780-Driver  A display driver for the HD44780 based displays.
+    Copyright (C) 2024 Jennifer Gunn (JennyDigital).
+
+	jennifer.a.gunn@outlook.com
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+    USA
+*/
+
+/** Host tool: replay an LCD_WaveWords() dump through an HD44780 model,
+  * checking the bus timing and the DDRAM contents it leaves.
+  *
+  * Build:   cc -O2 -o hd_wave_replay tools/hd_wave_replay.c
+  * Usage:   hd_wave_replay -p RS,RNW,E,D7,D6,D5,D4[,D3,D2,D1,D0]
+  *                         [-t tick_ns] [-e exec,data,clear] [-1]
+  *                         [-x addr=text]... dump.txt > listing.txt
+  *
+  * Each "HDW " line of the dump holds one BSRR word in hex, such as the
+  * output of printf( "HDW %08lX\n", ( unsigned long )words[ n ] ).  Other
+  * lines are ignored.  -p gives the GPIO pin number of each bus signal;
+  * eight data pins mean an 8-bit bus.  -t is LCD_WAVE_TICK_NS.  -e sets
+  * the execution times, in us, that each instruction, data write and
+  * clear or home must be given, by default the datasheet's 37, 41 and
+  * 1520.  -1 models a one-line display.  Each -x checks that DDRAM from
+  * addr holds text.
+  *
+  * The model starts as LCD_WaveStart() leaves the bus: every pin low,
+  * the controller idle, DDRAM blank and the address counter at 0.  The
+  * exit status is 1 if any timing rule or check failed.
+  */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/** Bus timing minimums in nanoseconds, from the HD44780U datasheet. */
+#define T_AS_NS             40u     // RS and R/W set up before E rises
+#define T_PWEH_NS           230u    // E high
+#define T_CYCE_NS           500u    // E rise to E rise
+
+#define MAX_CHECKS          16
+#define MAX_ERRORS_SHOWN    20
+
+#define CLR_DISP            0x01u
+#define RET_HOME            0x02u
+#define ENT_MODE            0x04u
+#define DISP_CTRL           0x08u
+#define CURS_DISP_SH        0x10u
+#define FUNC_SET            0x20u
+#define SET_CGRAM_ADD       0x40u
+#define SET_DDRAM_ADD       0x80u
+
+enum { PIN_RS, PIN_RNW, PIN_E, PIN_D7, PIN_D6, PIN_D5, PIN_D4, PIN_D3, PIN_D2, PIN_D1, PIN_D0, PIN_COUNT };
+
+
+/** Controller state followed through the waveform. */
+typedef struct
+{
+  uint8_t       ddram[ 128 ];
+  uint8_t       cgram[ 64 ];
+  unsigned int  ac;
+  int           in_cgram;
+  int           increment;
+  int           one_line;
+} model_t;
+
+
+typedef struct
+{
+  unsigned int  addr;
+  const char *  text;
+} check_t;
+
+
+static int             pins[ PIN_COUNT ];
+static int             n_pins       = 0;
+static int             bus_8bit     = 0;
+static unsigned long   tick_ns      = 4000;
+static unsigned long   exec_us      = 37,
+                       data_us      = 41,
+                       clear_us     = 1520;
+
+static unsigned long   n_commands   = 0,
+                       n_data       = 0,
+                       n_errors     = 0;
+
+
+static int level( uint32_t port, int pin )
+{
+  return ( port >> pins[ pin ] ) & 1u;
+}
+
+
+/** Data pin levels as a byte, low nibble zero on a 4-bit bus. */
+static unsigned int bus_value( uint32_t port )
+{
+  unsigned int value = 0;
+  int          pin;
+
+  for( pin = PIN_D7; pin < PIN_D7 + ( bus_8bit ? 8 : 4 ); pin++ )
+  {
+    value |= ( unsigned int )level( port, pin ) << ( 7 - ( pin - PIN_D7 ) );
+  }
+
+  return value;
+}
+
+
+/** Bus pins other than E, to spot changes that break setup or hold. */
+static uint32_t bus_pins( uint32_t port )
+{
+  uint32_t mask = 0;
+  int      pin;
+
+  for( pin = 0; pin < n_pins; pin++ )
+  {
+    if( pin != PIN_E ) mask |= 1ul << pins[ pin ];
+  }
+
+  return port & mask;
+}
+
+
+static void timing_error( unsigned long tick, const char * what, unsigned long long have, unsigned long long need )
+{
+  n_errors++;
+  if( n_errors <= MAX_ERRORS_SHOWN )
+  {
+    printf( "  ! word %lu: %s %llu ns, needs %llu ns\n", tick, what, have, need );
+  }
+}
+
+
+static void bus_error( unsigned long tick, const char * what )
+{
+  n_errors++;
+  if( n_errors <= MAX_ERRORS_SHOWN ) printf( "  ! word %lu: %s\n", tick, what );
+}
+
+
+static void step_ac( model_t * model )
+{
+  if( model->in_cgram )
+  {
+    model->ac = ( model->ac + ( model->increment ? 1u : 63u ) ) & 0x3Fu;
+  }
+  else if( model->one_line )
+  {
+    model->ac = model->increment ? ( model->ac + 1u ) % 80u : ( model->ac + 79u ) % 80u;
+  }
+  else if( model->increment )
+  {
+    model->ac = ( model->ac == 0x27u ) ? 0x40u : ( model->ac == 0x67u ) ? 0x00u : model->ac + 1u;
+  }
+  else
+  {
+    model->ac = ( model->ac == 0x40u ) ? 0x27u : ( model->ac == 0x00u ) ? 0x67u : model->ac - 1u;
+  }
+}
+
+
+/** Carry out one byte and return its execution time in nanoseconds. */
+static unsigned long long execute( model_t * model, int rs, unsigned int value, unsigned long long now )
+{
+  printf( "%10.3f us  %c  0x%02X", now / 1000.0, rs ? 'D' : 'C', value );
+
+  if( rs )
+  {
+    n_data++;
+    if( value >= 0x20u && value < 0x7Fu ) printf( " '%c'", value );
+    printf( " at %s 0x%02X\n", model->in_cgram ? "CGRAM" : "DDRAM", model->ac );
+
+    if( model->in_cgram ) model->cgram[ model->ac ] = ( uint8_t )value;
+    else                  model->ddram[ model->ac & 0x7Fu ] = ( uint8_t )value;
+    step_ac( model );
+
+    return data_us * 1000ull;
+  }
+
+  n_commands++;
+  putchar( '\n' );
+
+  if( value & SET_DDRAM_ADD )
+  {
+    model->ac       = value & 0x7Fu;
+    model->in_cgram = 0;
+  }
+  else if( value & SET_CGRAM_ADD )
+  {
+    model->ac       = value & 0x3Fu;
+    model->in_cgram = 1;
+  }
+  else if( value & ( FUNC_SET | DISP_CTRL ) )
+  {
+  }
+  else if( value & CURS_DISP_SH )
+  {
+    if( !( value & 0x08u ) )
+    {
+      int increment = model->increment;
+
+      model->increment = ( value & 0x04u ) != 0;
+      step_ac( model );
+      model->increment = increment;
+    }
+  }
+  else if( value & ENT_MODE )
+  {
+    model->increment = ( value & 0x02u ) != 0;
+  }
+  else if( value & ( RET_HOME | CLR_DISP ) )
+  {
+    if( value == CLR_DISP )
+    {
+      memset( model->ddram, ' ', sizeof( model->ddram ) );
+      model->increment = 1;
+    }
+    model->ac       = 0;
+    model->in_cgram = 0;
+
+    return clear_us * 1000ull;
+  }
+
+  return exec_us * 1000ull;
+}
+
+
+static int parse_pins( const char * text )
+{
+  char * end;
+
+  for( n_pins = 0; n_pins < PIN_COUNT; )
+  {
+    long pin = strtol( text, &end, 10 );
+
+    if( end == text || pin < 0 || pin > 15 ) return 0;
+    pins[ n_pins++ ] = ( int )pin;
+    if( *end != ',' ) break;
+    text = end + 1;
+  }
+
+  if( *end != '\0' ) return 0;
+  if( n_pins != PIN_D4 + 1 && n_pins != PIN_D0 + 1 ) return 0;
+
+  bus_8bit = ( n_pins == PIN_D0 + 1 );
+
+  return 1;
+}
+
+
+static void show_ddram( const model_t * model )
+{
+  unsigned int row,
+               col,
+               rows  = model->one_line ? 1u : 2u,
+               width = model->one_line ? 80u : 40u;
+
+  putchar( '\n' );
+  for( row = 0; row < rows; row++ )
+  {
+    printf( "0x%02X |", row * 0x40u );
+    for( col = 0; col < width; col++ )
+    {
+      uint8_t ch = model->ddram[ row * 0x40u + col ];
+
+      putchar( ( ch >= 0x20u && ch < 0x7Fu ) ? ch : '.' );
+    }
+    printf( "|\n" );
+  }
+}
+
+
+int main( int argc, char ** argv )
+{
+  FILE *              in;
+  char                text[ 256 ];
+  model_t             model;
+  check_t             checks[ MAX_CHECKS ];
+  int                 n_checks = 0,
+                      failed   = 0,
+                      arg,
+                      phase    = 0,
+                      rs       = 0;
+  unsigned int        value    = 0;
+  uint32_t            port     = 0,
+                      word;
+  unsigned long       tick     = 0;
+  unsigned long long  now,
+                      last_rise = 0,
+                      last_fall = 0,
+                      ready     = 0,
+                      bus_since = 0;
+  int                 risen     = 0;
+
+  memset( &model, 0, sizeof( model ) );
+  memset( model.ddram, ' ', sizeof( model.ddram ) );
+  model.increment = 1;
+
+  for( arg = 1; arg < argc - 1 && argv[ arg ][ 0 ] == '-'; arg++ )
+  {
+    if( strcmp( argv[ arg ], "-p" ) == 0 && arg + 1 < argc - 1 )
+    {
+      if( !parse_pins( argv[ ++arg ] ) ) break;
+    }
+    else if( strcmp( argv[ arg ], "-t" ) == 0 && arg + 1 < argc - 1 )
+    {
+      tick_ns = strtoul( argv[ ++arg ], NULL, 10 );
+    }
+    else if( strcmp( argv[ arg ], "-e" ) == 0 && arg + 1 < argc - 1 )
+    {
+      if( sscanf( argv[ ++arg ], "%lu,%lu,%lu", &exec_us, &data_us, &clear_us ) != 3 ) break;
+    }
+    else if( strcmp( argv[ arg ], "-1" ) == 0 )
+    {
+      model.one_line = 1;
+    }
+    else if( strcmp( argv[ arg ], "-x" ) == 0 && arg + 1 < argc - 1 && n_checks < MAX_CHECKS )
+    {
+      char * end;
+
+      checks[ n_checks ].addr = ( unsigned int )strtoul( argv[ ++arg ], &end, 0 );
+      if( *end != '=' || checks[ n_checks ].addr > 0x7Fu ) break;
+      checks[ n_checks++ ].text = end + 1;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if( n_pins == 0 || tick_ns == 0 || arg != argc - 1 )
+  {
+    fprintf( stderr, "usage: %s -p RS,RNW,E,D7,D6,D5,D4[,D3,D2,D1,D0] [-t tick_ns] "
+                     "[-e exec,data,clear] [-1] [-x addr=text]... dump.txt\n", argv[ 0 ] );
+    return 2;
+  }
+
+  in = strcmp( argv[ arg ], "-" ) ? fopen( argv[ arg ], "r" ) : stdin;
+  if( in == NULL )
+  {
+    perror( argv[ arg ] );
+    return 1;
+  }
+
+  while( fgets( text, sizeof( text ), in ) )
+  {
+    const char * start = strstr( text, "HDW " );
+    unsigned long parsed;
+    uint32_t      next;
+
+    if( start == NULL || sscanf( start, "HDW %lx", &parsed ) != 1 ) continue;
+
+    word = ( uint32_t )parsed;
+    now  = ( unsigned long long )tick * tick_ns;
+
+    /* BSRR: the set half wins over the reset half. */
+    next = ( port & ~( word >> 16 ) ) | ( word & 0xFFFFu );
+
+    if( bus_pins( next ) != bus_pins( port ) )
+    {
+      if( level( port, PIN_E ) ) bus_error( tick, "RS or data changed while E was high" );
+      bus_since = now;
+    }
+
+    if( !level( port, PIN_E ) && level( next, PIN_E ) )
+    {
+      if( now - bus_since < T_AS_NS ) timing_error( tick, "RS and data set up", now - bus_since, T_AS_NS );
+      if( risen && now - last_rise < T_CYCE_NS ) timing_error( tick, "E cycle", now - last_rise, T_CYCE_NS );
+      if( phase == 0 && now < ready ) timing_error( tick, "wait after the last byte", now - last_fall, ready - last_fall );
+      if( level( next, PIN_RNW ) ) bus_error( tick, "R/W high at E rise" );
+
+      last_rise = now;
+      risen     = 1;
+    }
+    else if( level( port, PIN_E ) && !level( next, PIN_E ) )
+    {
+      if( now - last_rise < T_PWEH_NS ) timing_error( tick, "E high", now - last_rise, T_PWEH_NS );
+
+      /* Latched from the levels held while E was high. */
+      if( bus_8bit )
+      {
+        rs    = level( port, PIN_RS );
+        value = bus_value( port );
+        phase = 2;
+      }
+      else if( phase == 0 )
+      {
+        rs    = level( port, PIN_RS );
+        value = bus_value( port );
+        phase = 1;
+      }
+      else
+      {
+        value |= bus_value( port ) >> 4;
+        phase  = 2;
+      }
+
+      if( phase == 2 )
+      {
+        ready     = now + execute( &model, rs, value, last_rise );
+        last_fall = now;
+        phase     = 0;
+      }
+    }
+
+    port = next;
+    tick++;
+  }
+
+  if( in != stdin ) fclose( in );
+
+  if( phase ) printf( "  ! waveform ends between the nibbles of a byte\n" );
+
+  show_ddram( &model );
+
+  for( arg = 0; arg < n_checks; arg++ )
+  {
+    unsigned int addr = checks[ arg ].addr,
+                 i;
+
+    for( i = 0; checks[ arg ].text[ i ]; i++ )
+    {
+      if( model.ddram[ ( addr + i ) & 0x7Fu ] != ( uint8_t )checks[ arg ].text[ i ] ) break;
+    }
+    if( checks[ arg ].text[ i ] )
+    {
+      printf( "  ! DDRAM 0x%02X does not hold \"%s\"\n", addr, checks[ arg ].text );
+      failed++;
+    }
+  }
+
+  printf( "\n%lu commands, %lu data writes, %lu timing errors, %d failed checks, %.3f us played\n",
+          n_commands, n_data, n_errors, failed, ( double )tick * tick_ns / 1000.0 );
+
+  return ( n_errors || failed || phase ) ? 1 : 0;
+}